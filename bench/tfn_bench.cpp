@@ -0,0 +1,458 @@
+// Micro-benchmarks of the transfer function engine's hot paths, without any UI. Each
+// benchmark is warmed up, then timed over a number of samples of a calibrated batch of
+// iterations, and the per-iteration percentiles are printed and optionally written as JSON
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "transfer_function_engine.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define dup _dup
+#define dup2 _dup2
+#define fileno _fileno
+#define close _close
+#define NULL_DEVICE "NUL"
+#else
+#include <unistd.h>
+#define NULL_DEVICE "/dev/null"
+#endif
+
+using namespace ImTF;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    size_t samples = 30;
+    size_t warmup = 3;
+    // Iterations are batched until a sample takes at least this long
+    double min_sample_us = 1000.0;
+    std::string filter;
+    std::string json_path;
+    std::string state_path = "tfn_bench_state.txt";
+};
+
+struct Result {
+    std::string name;
+    size_t batch = 0;
+    size_t samples = 0;
+    double min_ns = 0.0;
+    double median_ns = 0.0;
+    double p90_ns = 0.0;
+    double p99_ns = 0.0;
+    double max_ns = 0.0;
+    double mean_ns = 0.0;
+};
+
+// Keep the compiler from optimizing away a result
+template <typename T>
+void do_not_optimize(const T &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void *sink;
+    sink = &value;
+#endif
+}
+
+double elapsed_ns(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// The p-th percentile of the sorted samples, interpolated between the closest ranks
+double percentile(const std::vector<double> &sorted, double p)
+{
+    const double rank = p / 100.0 * (sorted.size() - 1);
+    const size_t lo = static_cast<size_t>(rank);
+    const size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+}
+
+// Discards stdout while alive, e.g. to keep the messages printed by SaveState and
+// LoadState out of the report
+class SilenceStdout {
+    int saved = -1;
+
+public:
+    SilenceStdout()
+    {
+        std::fflush(stdout);
+        saved = dup(fileno(stdout));
+        FILE *null_device = std::fopen(NULL_DEVICE, "w");
+        if (null_device) {
+            dup2(fileno(null_device), fileno(stdout));
+            std::fclose(null_device);
+        }
+    }
+
+    ~SilenceStdout()
+    {
+        std::fflush(stdout);
+        if (saved >= 0) {
+            dup2(saved, fileno(stdout));
+            close(saved);
+        }
+    }
+};
+
+class Runner {
+    Options options;
+    std::vector<Result> results;
+
+public:
+    explicit Runner(const Options &options) : options(options) {}
+
+    // Time fn, which runs one iteration of the benchmark. If quiet is set anything fn
+    // prints to stdout is discarded
+    void Run(const std::string &name, const std::function<void()> &fn, bool quiet = false)
+    {
+        if (!options.filter.empty() && name.find(options.filter) == std::string::npos) {
+            return;
+        }
+        std::unique_ptr<SilenceStdout> silence(quiet ? new SilenceStdout() : nullptr);
+
+        // Warm up, and find how many iterations make a sample long enough to time
+        size_t batch = 1;
+        for (size_t i = 0; i < options.warmup; ++i) {
+            fn();
+        }
+        for (;;) {
+            const auto start = Clock::now();
+            for (size_t i = 0; i < batch; ++i) {
+                fn();
+            }
+            const double ns = elapsed_ns(start);
+            if (ns >= options.min_sample_us * 1000.0 || batch >= (size_t(1) << 24)) {
+                break;
+            }
+            batch *= ns > 0.0 ? std::max<size_t>(2, options.min_sample_us * 1000.0 / ns) : 16;
+        }
+
+        std::vector<double> times(options.samples);
+        for (auto &t : times) {
+            const auto start = Clock::now();
+            for (size_t i = 0; i < batch; ++i) {
+                fn();
+            }
+            t = elapsed_ns(start) / batch;
+        }
+        silence.reset();
+        std::sort(times.begin(), times.end());
+
+        Result r;
+        r.name = name;
+        r.batch = batch;
+        r.samples = times.size();
+        r.min_ns = times.front();
+        r.median_ns = percentile(times, 50.0);
+        r.p90_ns = percentile(times, 90.0);
+        r.p99_ns = percentile(times, 99.0);
+        r.max_ns = times.back();
+        for (const auto &t : times) {
+            r.mean_ns += t / times.size();
+        }
+        results.push_back(r);
+
+        std::printf("%-48s %12.0f %12.0f %12.0f %12.0f  x%zu\n",
+                    name.c_str(),
+                    r.min_ns,
+                    r.median_ns,
+                    r.p90_ns,
+                    r.p99_ns,
+                    batch);
+        std::fflush(stdout);
+    }
+
+    bool WriteJSON(const std::string &path) const
+    {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Failed to open " << path << " for writing\n";
+            return false;
+        }
+        out << "{\n  \"samples\": " << options.samples << ",\n  \"warmup\": " << options.warmup
+            << ",\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result &r = results[i];
+            out << "    {\"name\": \"" << r.name << "\", \"batch\": " << r.batch
+                << ", \"samples\": " << r.samples << ", \"min_ns\": " << r.min_ns
+                << ", \"median_ns\": " << r.median_ns << ", \"p90_ns\": " << r.p90_ns
+                << ", \"p99_ns\": " << r.p99_ns << ", \"max_ns\": " << r.max_ns
+                << ", \"mean_ns\": " << r.mean_ns << "}"
+                << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}\n";
+        return static_cast<bool>(out);
+    }
+};
+
+// Exposes the full table rebuild, so it's timed without the undo history diffing and
+// recording the setters do after each change
+class RebuildEngine : public TransferFunctionEngine {
+public:
+    void Rebuild()
+    {
+        UpdateColormap();
+    }
+};
+
+// A colormap of n entries, selected in the widget through its state
+void select_colormap_size(TransferFunctionEngine &widget, size_t n)
+{
+    std::vector<uint8_t> colors(n * 4);
+    for (size_t i = 0; i < n; ++i) {
+        colors[i * 4] = static_cast<uint8_t>(i * 255 / (n - 1));
+        colors[i * 4 + 1] = static_cast<uint8_t>(255 - i * 255 / (n - 1));
+        colors[i * 4 + 2] = static_cast<uint8_t>(i * 7);
+        colors[i * 4 + 3] = 255;
+    }
+    TransferFunctionState state = widget.GetState();
+    state.colors = colors;
+    widget.SetState(state);
+}
+
+// Give the widget a curve of n points mixing the interpolation modes
+void set_control_points(TransferFunctionEngine &widget, size_t n)
+{
+    TransferFunctionState state = widget.GetState();
+    state.control_x.resize(n);
+    state.control_y.resize(n);
+    state.modes.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        state.control_x[i] = static_cast<float>(i) / (n - 1);
+        state.control_y[i] = 0.5f + 0.5f * std::sin(i * 0.7f);
+        state.modes[i] = static_cast<InterpolationMode>(i % NUM_INTERPOLATION_MODES);
+    }
+    widget.SetState(state);
+}
+
+template <typename Format>
+void bench_overlay_format(Runner &runner,
+                          TransferFunctionEngine &widget,
+                          const char *format_name,
+                          int width,
+                          int height,
+                          float scale,
+                          OverlayMode mode)
+{
+    std::vector<typename Format::channel_type> image(size_t(width) * height * Format::channels);
+    const std::string name = std::string("overlay/") + format_name +
+                             (mode == OVERLAY_ALPHA_BLEND ? "/blend/" : "/overwrite/") +
+                             std::to_string(width) + "x" + std::to_string(height) + "/x" +
+                             std::to_string(static_cast<int>(scale));
+    runner.Run(name, [&]() {
+        widget.OverlayColormapBar<Format>(image.data(),
+                                          width,
+                                          height,
+                                          0,
+                                          vec2f(0.05f, 0.05f),
+                                          vec2f(0.f, 100.f),
+                                          scale,
+                                          false,
+                                          mode);
+        do_not_optimize(image.data());
+    });
+}
+
+// Classify the values with a fixed size table exported from the widget
+template <typename Table>
+void bench_classify_fixed(Runner &runner,
+                          TransferFunctionEngine &widget,
+                          const std::string &name,
+                          const std::vector<float> &values)
+{
+    Table table;
+    widget.Export(table, vec2f(0.f, 100.f));
+    std::vector<typename Table::channel_type> pixels(values.size() * Table::channels);
+    runner.Run(name, [&]() {
+        table.Classify(values.data(), values.size(), pixels.data());
+        do_not_optimize(pixels.data());
+    });
+}
+
+void print_usage()
+{
+    std::cout << "Usage: tfn_bench [options]\n"
+              << "  --json <file>        Write the results as JSON\n"
+              << "  --filter <text>      Only run benchmarks whose name contains text\n"
+              << "  --samples <n>        Timed samples per benchmark (default 30)\n"
+              << "  --warmup <n>         Untimed warm-up iterations (default 3)\n"
+              << "  --min-sample-us <us> Minimum duration of a sample (default 1000)\n"
+              << "  --state-file <file>  Scratch file for SaveState/LoadState\n";
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--json" && has_value) {
+            options.json_path = argv[++i];
+        } else if (arg == "--filter" && has_value) {
+            options.filter = argv[++i];
+        } else if (arg == "--samples" && has_value) {
+            options.samples = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--warmup" && has_value) {
+            options.warmup = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--min-sample-us" && has_value) {
+            options.min_sample_us = std::atof(argv[++i]);
+        } else if (arg == "--state-file" && has_value) {
+            options.state_path = argv[++i];
+        } else {
+            print_usage();
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+
+    Runner runner(options);
+    std::printf("%-48s %12s %12s %12s %12s\n", "benchmark (ns/iter)", "min", "median", "p90", "p99");
+
+    // Constructing decodes and linearizes all the embedded presets
+    runner.Run("construct", []() {
+        TransferFunctionEngine widget;
+        do_not_optimize(widget.ColormapVersion());
+    });
+
+    // Full table rebuilds
+    for (const size_t entries : {size_t(0), size_t(4096), size_t(65536)}) {
+        for (const size_t points : {size_t(2), size_t(64)}) {
+            RebuildEngine widget;
+            if (entries) {
+                select_colormap_size(widget, entries);
+            }
+            set_control_points(widget, points);
+            const size_t n = widget.ColormapTable().size() / 4;
+            runner.Run("update_colormap/" + std::to_string(n) + "/points" + std::to_string(points),
+                       [&]() {
+                           widget.Rebuild();
+                           do_not_optimize(widget.ColormapTable().data());
+                       });
+        }
+    }
+
+    for (const size_t entries : {size_t(0), size_t(65536)}) {
+        TransferFunctionEngine widget;
+        if (entries) {
+            select_colormap_size(widget, entries);
+        }
+        const std::string n = std::to_string(widget.ColormapTable().size() / 4);
+        runner.Run("get_colormap/" + n, [&]() {
+            std::vector<uint8_t> table = widget.GetColormap();
+            do_not_optimize(table.data());
+        });
+        runner.Run("get_colormapf/" + n, [&]() {
+            std::vector<float> table = widget.GetColormapf();
+            do_not_optimize(table.data());
+        });
+        std::vector<float> color, opacity;
+        runner.Run("get_colormapf_split/" + n, [&]() {
+            widget.GetColormapf(color, opacity);
+            do_not_optimize(color.data());
+            do_not_optimize(opacity.data());
+        });
+    }
+
+    // Classifying through the widget's runtime sized table and fixed size tables
+    {
+        TransferFunctionEngine widget;
+        std::vector<float> values(1 << 20);
+        for (size_t i = 0; i < values.size(); ++i) {
+            values[i] = static_cast<float>(i * 7919 % 100003) / 1000.f;
+        }
+        std::vector<uint8_t> rgba(values.size() * 4);
+        const std::string n = std::to_string(widget.ColormapTable().size() / 4);
+        runner.Run("classify/runtime/" + n + "/1M", [&]() {
+            widget.Classify(values.data(), values.size(), vec2f(0.f, 100.f), rgba.data());
+            do_not_optimize(rgba.data());
+        });
+        bench_classify_fixed<TransferFunction<256>>(
+            runner, widget, "classify/fixed/256/rgba8/1M", values);
+        bench_classify_fixed<TransferFunction<256, RGBA8Format, LOOKUP_LINEAR>>(
+            runner, widget, "classify/fixed/256/rgba8/linear/1M", values);
+        bench_classify_fixed<TransferFunction<256, RGBA32FFormat>>(
+            runner, widget, "classify/fixed/256/rgba32f/1M", values);
+        bench_classify_fixed<TransferFunction<4096, RGBA8Format>>(
+            runner, widget, "classify/fixed/4096/rgba8/1M", values);
+    }
+
+    // Overlays reuse the cached bar sprite, except for the rebuild benchmark which
+    // changes the labels every iteration
+    {
+        TransferFunctionEngine widget;
+        const int sizes[][2] = {{640, 480}, {1920, 1080}, {3840, 2160}};
+        for (const auto &size : sizes) {
+            const int width = size[0];
+            const int height = size[1];
+            for (const float scale : {1.f, 2.f, 4.f}) {
+                // Bars which don't fit in the image aren't drawn, which would only time
+                // the early return, so skip them
+                std::vector<uint32_t> image(size_t(width) * height);
+                widget.OverlayColormapBar(
+                    image, width, height, vec2f(0.05f, 0.05f), vec2f(0.f, 100.f), scale);
+                if (std::all_of(image.begin(), image.end(), [](uint32_t p) { return p == 0; })) {
+                    continue;
+                }
+                const std::string name = "overlay/vector/" + std::to_string(width) + "x" +
+                                         std::to_string(height) + "/x" +
+                                         std::to_string(static_cast<int>(scale));
+                runner.Run(name, [&]() {
+                    widget.OverlayColormapBar(
+                        image, width, height, vec2f(0.05f, 0.05f), vec2f(0.f, 100.f), scale);
+                    do_not_optimize(image.data());
+                });
+            }
+        }
+        for (const float scale : {1.f, 2.f, 4.f}) {
+            bench_overlay_format<RGBA8Format>(runner, widget, "rgba8", 1920, 1080, scale, OVERLAY_OVERWRITE);
+            bench_overlay_format<RGBA8Format>(runner, widget, "rgba8", 1920, 1080, scale, OVERLAY_ALPHA_BLEND);
+            bench_overlay_format<BGRA8Format>(runner, widget, "bgra8", 1920, 1080, scale, OVERLAY_OVERWRITE);
+            bench_overlay_format<RGB8Format>(runner, widget, "rgb8", 1920, 1080, scale, OVERLAY_OVERWRITE);
+            bench_overlay_format<RGBA16Format>(runner, widget, "rgba16", 1920, 1080, scale, OVERLAY_OVERWRITE);
+            bench_overlay_format<RGBA32FFormat>(runner, widget, "rgba32f", 1920, 1080, scale, OVERLAY_OVERWRITE);
+        }
+
+        std::vector<uint32_t> image(1920 * 1080);
+        float max_value = 100.f;
+        runner.Run("overlay/vector/rebuild/1920x1080/x2", [&]() {
+            max_value = max_value == 100.f ? 200.f : 100.f;
+            widget.OverlayColormapBar(
+                image, 1920, 1080, vec2f(0.05f, 0.05f), vec2f(0.f, max_value), 2.f);
+            do_not_optimize(image.data());
+        });
+    }
+
+    {
+        TransferFunctionEngine widget;
+        set_control_points(widget, 64);
+        runner.Run(
+            "save_state/points64",
+            [&]() { do_not_optimize(widget.SaveState(options.state_path)); },
+            true);
+        runner.Run(
+            "load_state/points64",
+            [&]() { do_not_optimize(widget.LoadState(options.state_path)); },
+            true);
+        std::remove(options.state_path.c_str());
+    }
+
+    if (!options.json_path.empty() && !runner.WriteJSON(options.json_path)) {
+        return 1;
+    }
+    return 0;
+}
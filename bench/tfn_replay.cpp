@@ -0,0 +1,257 @@
+// Replays an input recording (see input_recording.h) against the widget headless, to
+// compare the interaction latency of versions of the widget on identical input. The
+// widget is drawn as DrawColorMap, DrawOpacityScale and DrawRanges in an undecorated
+// window at the top-left of the display, the size of the window it was recorded in, and
+// the recording should be made with the same layout. A hash of the final table is
+// reported to check the versions compared ended up in the same state
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "imgui.h"
+#include "input_recording.h"
+#include "transfer_function_widget.h"
+
+using namespace ImTF;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const ImVec2 default_window_size(800.f, 600.f);
+const ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoMove;
+
+struct Options {
+    std::string recording_path;
+    std::string synthesize_path;
+    std::string json_path;
+    size_t repeat = 5;
+};
+
+void draw_widget(TransferFunctionWidget &widget, ImVec2 window_size)
+{
+    ImGui::SetNextWindowPos(ImVec2(0.f, 0.f));
+    ImGui::SetNextWindowSize(window_size);
+    ImGui::Begin("Transfer Function", nullptr, window_flags);
+    widget.DrawColorMap(false);
+    widget.DrawOpacityScale();
+    widget.DrawRanges();
+    ImGui::End();
+}
+
+void create_context(ImVec2 window_size)
+{
+    ImGui::CreateContext();
+    ImGuiIO &io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    // The recording holds the input ImGui saw in each frame, don't spread it out again
+    io.ConfigInputTrickleEventQueue = false;
+    io.DisplaySize = window_size;
+    unsigned char *pixels = nullptr;
+    int width = 0, height = 0;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+    io.Fonts->SetTexID(reinterpret_cast<ImTextureID>(intptr_t(1)));
+}
+
+uint64_t hash_table(const std::vector<uint8_t> &table)
+{
+    // FNV-1a
+    uint64_t h = 1469598103934665603ull;
+    for (const auto &b : table) {
+        h = (h ^ b) * 1099511628211ull;
+    }
+    return h;
+}
+
+// Script an editing session: add points, drag them around, remove one and undo
+bool synthesize(const std::string &path)
+{
+    const ImVec2 window_size = default_window_size;
+    create_context(window_size);
+
+    // Find where the canvas is, it's below the row of colormap controls
+    ImGui::NewFrame();
+    ImGui::SetNextWindowPos(ImVec2(0.f, 0.f));
+    ImGui::SetNextWindowSize(window_size);
+    ImGui::Begin("Transfer Function", nullptr, window_flags);
+    const ImVec2 canvas_pos(ImGui::GetCursorPos().x,
+                            ImGui::GetCursorPos().y + ImGui::GetFrameHeightWithSpacing());
+    ImVec2 canvas_size = ImGui::GetContentRegionAvail();
+    canvas_size.y = (canvas_size.y - ImGui::GetFrameHeightWithSpacing()) / 3.f;
+    ImGui::End();
+    ImGui::EndFrame();
+    ImGui::DestroyContext();
+
+    InputRecorder recorder;
+    recorder.SetWindowSize(window_size);
+    InputFrame frame;
+    auto to_canvas = [&](float x, float y) {
+        return ImVec2(canvas_pos.x + x * canvas_size.x, canvas_pos.y + (1.f - y) * canvas_size.y);
+    };
+    auto hold = [&](int frames) {
+        for (int i = 0; i < frames; ++i) {
+            recorder.AddFrame(frame);
+        }
+    };
+    auto click = [&](int button, float x, float y) {
+        frame.mouse_pos = to_canvas(x, y);
+        hold(2);
+        frame.mouse_buttons = static_cast<uint8_t>(1 << button);
+        hold(2);
+        frame.mouse_buttons = 0;
+        hold(2);
+    };
+    auto drag = [&](float x0, float y0, float x1, float y1, int frames) {
+        frame.mouse_pos = to_canvas(x0, y0);
+        hold(2);
+        frame.mouse_buttons = 1;
+        for (int i = 0; i <= frames; ++i) {
+            const float t = static_cast<float>(i) / frames;
+            frame.mouse_pos = to_canvas(x0 + (x1 - x0) * t, y0 + (y1 - y0) * t);
+            recorder.AddFrame(frame);
+        }
+        frame.mouse_buttons = 0;
+        hold(2);
+    };
+
+    hold(10);
+    const float xs[] = {0.15f, 0.3f, 0.45f, 0.6f, 0.75f, 0.9f};
+    for (size_t i = 0; i < sizeof(xs) / sizeof(xs[0]); ++i) {
+        click(0, xs[i], i % 2 ? 0.8f : 0.2f);
+    }
+    for (int pass = 0; pass < 4; ++pass) {
+        drag(0.3f, 0.8f, 0.35f, 0.1f, 60);
+        drag(0.35f, 0.1f, 0.3f, 0.8f, 60);
+    }
+    drag(0.3f, 0.8f, 0.35f, 0.5f, 30);
+    // Make a segment smooth, then remove a point and undo removing it
+    click(2, 0.5f, 0.5f);
+    click(1, 0.6f, 0.8f);
+    // Ctrl+Z
+    frame.keys_down = {uint16_t(ImGuiKey_LeftCtrl), uint16_t(ImGuiKey_ModCtrl)};
+    hold(2);
+    frame.keys_down = {uint16_t(ImGuiKey_Z), uint16_t(ImGuiKey_LeftCtrl), uint16_t(ImGuiKey_ModCtrl)};
+    hold(2);
+    frame.keys_down.clear();
+    hold(10);
+    return recorder.Save(path);
+}
+
+void print_usage()
+{
+    std::cout << "Usage: tfn_replay <recording> [options]\n"
+              << "  --repeat <n>            Replay the recording n times (default 5)\n"
+              << "  --json <file>           Write the results as JSON\n"
+              << "       tfn_replay --synthesize <file>\n"
+              << "  Write a scripted editing session to replay\n";
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--json" && has_value) {
+            options.json_path = argv[++i];
+        } else if (arg == "--repeat" && has_value) {
+            options.repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--synthesize" && has_value) {
+            options.synthesize_path = argv[++i];
+        } else if (arg[0] != '-' && options.recording_path.empty()) {
+            options.recording_path = arg;
+        } else {
+            print_usage();
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+    if (!options.synthesize_path.empty()) {
+        return synthesize(options.synthesize_path) ? 0 : 1;
+    }
+    if (options.recording_path.empty()) {
+        print_usage();
+        return 1;
+    }
+
+    InputReplay replay;
+    if (!replay.Load(options.recording_path) || replay.NumFrames() == 0) {
+        return 1;
+    }
+    ImVec2 window_size = replay.WindowSize();
+    if (window_size.x <= 0.f || window_size.y <= 0.f) {
+        window_size = default_window_size;
+    }
+
+    // Each run replays the recording from scratch, with a new context and widget
+    std::vector<double> frame_us;
+    uint64_t table_hash = 0;
+    size_t control_points = 0;
+    for (size_t run = 0; run < options.repeat; ++run) {
+        create_context(window_size);
+        TransferFunctionWidget widget(true);
+        widget.SetHeadless(true);
+        ImGuiIO &io = ImGui::GetIO();
+        for (size_t i = 0; i < replay.NumFrames(); ++i) {
+            const auto start = Clock::now();
+            replay.ApplyFrame(i, io);
+            ImGui::NewFrame();
+            draw_widget(widget, window_size);
+            ImGui::Render();
+            frame_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+        }
+        // Let any in progress edit finish
+        widget.PollRebuild(true);
+        table_hash = hash_table(widget.ColormapTable());
+        control_points = widget.GetState().control_x.size();
+        ImGui::DestroyContext();
+    }
+
+    std::vector<double> sorted = frame_us;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&](double p) {
+        const double rank = p / 100.0 * (sorted.size() - 1);
+        const size_t lo = static_cast<size_t>(rank);
+        const size_t hi = std::min(lo + 1, sorted.size() - 1);
+        return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+    };
+    double total_us = 0.0;
+    for (const auto &t : frame_us) {
+        total_us += t;
+    }
+    std::printf("frames %zu x %zu, mean %.1f us, median %.1f us, p90 %.1f us, p99 %.1f us, "
+                "max %.1f us\n",
+                replay.NumFrames(),
+                options.repeat,
+                total_us / frame_us.size(),
+                percentile(50.0),
+                percentile(90.0),
+                percentile(99.0),
+                sorted.back());
+    std::printf("final state: %zu control points, table hash %016llx\n",
+                control_points,
+                static_cast<unsigned long long>(table_hash));
+
+    if (!options.json_path.empty()) {
+        std::ofstream out(options.json_path);
+        if (!out) {
+            std::cerr << "Failed to open " << options.json_path << " for writing\n";
+            return 1;
+        }
+        char hash[17];
+        std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(table_hash));
+        out << "{\n  \"recording\": \"" << options.recording_path << "\",\n  \"frames\": "
+            << replay.NumFrames() << ",\n  \"repeat\": " << options.repeat
+            << ",\n  \"mean_us\": " << total_us / frame_us.size()
+            << ",\n  \"median_us\": " << percentile(50.0) << ",\n  \"p90_us\": " << percentile(90.0)
+            << ",\n  \"p99_us\": " << percentile(99.0) << ",\n  \"max_us\": " << sorted.back()
+            << ",\n  \"control_points\": " << control_points << ",\n  \"table_hash\": \"" << hash
+            << "\"\n}\n";
+    }
+    return 0;
+}
@@ -0,0 +1,336 @@
+// Measures the cost of drawing the widget's UI: the geometry, draw commands, heap
+// allocations and CPU time per frame of DrawColorMap, DrawRuler and DrawRanges. The UI
+// is drawn headless into an ImGui context without a renderer backend, so no GL context
+// is needed, at each combination of canvas size and number of control points
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "imgui.h"
+#include "transfer_function_widget.h"
+
+using namespace ImTF;
+
+namespace {
+
+// Heap allocations made through new and by ImGui
+std::atomic<uint64_t> allocations(0);
+
+void *counting_malloc(size_t size, void *)
+{
+    ++allocations;
+    return std::malloc(size);
+}
+
+void counting_free(void *ptr, void *)
+{
+    std::free(ptr);
+}
+
+}
+
+void *operator new(std::size_t size)
+{
+    ++allocations;
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    size_t frames = 200;
+    size_t warmup = 10;
+    std::vector<std::pair<int, int>> sizes = {{400, 200}, {800, 300}, {1600, 400}, {3200, 600}};
+    std::vector<size_t> points = {2, 16, 128, 1024};
+    std::string json_path;
+};
+
+// The per-frame cost of one of the draw functions
+struct Cost {
+    std::vector<double> times_us;
+    uint64_t vertices = 0;
+    uint64_t indices = 0;
+    uint64_t commands = 0;
+    uint64_t allocations = 0;
+
+    double Percentile(double p) const
+    {
+        std::vector<double> sorted = times_us;
+        std::sort(sorted.begin(), sorted.end());
+        const double rank = p / 100.0 * (sorted.size() - 1);
+        const size_t lo = static_cast<size_t>(rank);
+        const size_t hi = std::min(lo + 1, sorted.size() - 1);
+        return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+    }
+};
+
+// Measures the draw calls made while alive into the current window's draw list
+class Measure {
+    Cost &cost;
+    bool record;
+    ImDrawList *draw_list;
+    int vertices, indices, commands;
+    uint64_t start_allocations;
+    Clock::time_point start;
+
+public:
+    Measure(Cost &cost, bool record)
+        : cost(cost),
+          record(record),
+          draw_list(ImGui::GetWindowDrawList()),
+          vertices(draw_list->VtxBuffer.Size),
+          indices(draw_list->IdxBuffer.Size),
+          commands(draw_list->CmdBuffer.Size),
+          start_allocations(allocations.load()),
+          start(Clock::now())
+    {
+    }
+
+    ~Measure()
+    {
+        const double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+        if (!record) {
+            return;
+        }
+        cost.times_us.push_back(us);
+        cost.vertices += draw_list->VtxBuffer.Size - vertices;
+        cost.indices += draw_list->IdxBuffer.Size - indices;
+        cost.commands += draw_list->CmdBuffer.Size - commands;
+        cost.allocations += allocations.load() - start_allocations;
+    }
+};
+
+struct Result {
+    int width, height;
+    size_t points;
+    // The draw functions, then the whole frame including NewFrame and Render
+    Cost costs[4];
+};
+
+const char *cost_names[] = {"DrawColorMap", "DrawRuler", "DrawRanges", "frame"};
+
+// Give the widget a curve of n points mixing the interpolation modes
+void set_control_points(TransferFunctionWidget &widget, size_t n)
+{
+    TransferFunctionState state = widget.GetState();
+    state.control_x.resize(n);
+    state.control_y.resize(n);
+    state.modes.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        state.control_x[i] = static_cast<float>(i) / (n - 1);
+        state.control_y[i] = 0.5f + 0.5f * std::sin(i * 0.7f);
+        state.modes[i] = static_cast<InterpolationMode>(i % NUM_INTERPOLATION_MODES);
+    }
+    widget.SetState(state);
+}
+
+Result run(const Options &options, int width, int height, size_t points)
+{
+    Result result;
+    result.width = width;
+    result.height = height;
+    result.points = points;
+
+    TransferFunctionWidget widget(true);
+    widget.SetHeadless(true);
+    set_control_points(widget, points);
+
+    ImGuiIO &io = ImGui::GetIO();
+    // The window is sized so the canvas, which fills the content region, is width wide
+    const ImVec2 padding = ImGui::GetStyle().WindowPadding;
+    io.DisplaySize = ImVec2(width + 2.f * padding.x + 64.f, height + 400.f);
+    for (size_t frame = 0; frame < options.warmup + options.frames; ++frame) {
+        const bool record = frame >= options.warmup;
+        const uint64_t frame_allocations = allocations.load();
+        const auto frame_start = Clock::now();
+        io.DeltaTime = 1.f / 60.f;
+        // Hover the middle of the canvas, as when the user is about to edit it
+        io.MousePos = ImVec2(io.DisplaySize.x * 0.5f, 100.f);
+        ImGui::NewFrame();
+        ImGui::SetNextWindowPos(ImVec2(0.f, 0.f));
+        ImGui::SetNextWindowSize(ImVec2(width + 2.f * padding.x, io.DisplaySize.y));
+        ImGui::Begin("Transfer Function", nullptr, ImGuiWindowFlags_NoDecoration);
+        {
+            Measure m(result.costs[0], record);
+            widget.DrawColorMap(false);
+        }
+        {
+            Measure m(result.costs[1], record);
+            widget.DrawRuler(ImVec2(0.f, 100.f));
+        }
+        {
+            Measure m(result.costs[2], record);
+            widget.DrawRanges();
+        }
+        ImGui::End();
+        ImGui::Render();
+        if (!record) {
+            continue;
+        }
+
+        // The whole frame's geometry is everything drawn, including ImGui's own
+        Cost &frame_cost = result.costs[3];
+        frame_cost.times_us.push_back(
+            std::chrono::duration<double, std::micro>(Clock::now() - frame_start).count());
+        frame_cost.allocations += allocations.load() - frame_allocations;
+        const ImDrawData *draw_data = ImGui::GetDrawData();
+        frame_cost.vertices += draw_data->TotalVtxCount;
+        frame_cost.indices += draw_data->TotalIdxCount;
+        for (int i = 0; i < draw_data->CmdListsCount; ++i) {
+            frame_cost.commands += draw_data->CmdLists[i]->CmdBuffer.Size;
+        }
+    }
+    return result;
+}
+
+std::vector<std::string> split(const std::string &s, char delim)
+{
+    std::vector<std::string> parts;
+    std::stringstream ss(s);
+    std::string part;
+    while (std::getline(ss, part, delim)) {
+        if (!part.empty()) {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+void print_usage()
+{
+    std::cout << "Usage: tfn_ui_bench [options]\n"
+              << "  --json <file>          Write the results as JSON\n"
+              << "  --frames <n>           Measured frames per configuration (default 200)\n"
+              << "  --warmup <n>           Unmeasured frames first (default 10)\n"
+              << "  --sizes <WxH,...>      Canvas sizes (default 400x200,800x300,1600x400,3200x600)\n"
+              << "  --points <n,...>       Control point counts (default 2,16,128,1024)\n";
+}
+
+bool write_json(const std::string &path, const Options &options, const std::vector<Result> &results)
+{
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to open " << path << " for writing\n";
+        return false;
+    }
+    out << "{\n  \"frames\": " << options.frames << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &r = results[i];
+        out << "    {\"width\": " << r.width << ", \"height\": " << r.height
+            << ", \"points\": " << r.points;
+        for (int c = 0; c < 4; ++c) {
+            const Cost &cost = r.costs[c];
+            const double frames = static_cast<double>(cost.times_us.size());
+            out << ",\n     \"" << cost_names[c] << "\": {\"median_us\": " << cost.Percentile(50.0)
+                << ", \"p90_us\": " << cost.Percentile(90.0)
+                << ", \"p99_us\": " << cost.Percentile(99.0)
+                << ", \"vertices\": " << cost.vertices / frames
+                << ", \"indices\": " << cost.indices / frames
+                << ", \"draw_commands\": " << cost.commands / frames
+                << ", \"allocations\": " << cost.allocations / frames << "}";
+        }
+        out << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--json" && has_value) {
+            options.json_path = argv[++i];
+        } else if (arg == "--frames" && has_value) {
+            options.frames = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--warmup" && has_value) {
+            options.warmup = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--sizes" && has_value) {
+            options.sizes.clear();
+            for (const auto &size : split(argv[++i], ',')) {
+                int w = 0, h = 0;
+                if (std::sscanf(size.c_str(), "%dx%d", &w, &h) == 2 && w > 0 && h > 0) {
+                    options.sizes.emplace_back(w, h);
+                }
+            }
+        } else if (arg == "--points" && has_value) {
+            options.points.clear();
+            for (const auto &n : split(argv[++i], ',')) {
+                options.points.push_back(std::max(2, std::atoi(n.c_str())));
+            }
+        } else {
+            print_usage();
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+
+    ImGui::SetAllocatorFunctions(counting_malloc, counting_free);
+    ImGui::CreateContext();
+    ImGuiIO &io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    // Build the font atlas and give it a stub texture ID, there's no renderer to upload it
+    unsigned char *pixels = nullptr;
+    int atlas_width = 0, atlas_height = 0;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &atlas_width, &atlas_height);
+    io.Fonts->SetTexID(reinterpret_cast<ImTextureID>(intptr_t(1)));
+
+    std::printf("%-10s %6s  %-12s %10s %10s %10s %10s %8s %8s\n",
+                "canvas", "points", "call", "median us", "p99 us", "vertices", "indices",
+                "cmds", "allocs");
+    std::vector<Result> results;
+    for (const auto &size : options.sizes) {
+        for (const auto &points : options.points) {
+            results.push_back(run(options, size.first, size.second, points));
+            const Result &r = results.back();
+            for (int c = 0; c < 4; ++c) {
+                const Cost &cost = r.costs[c];
+                const double frames = static_cast<double>(cost.times_us.size());
+                std::printf("%4dx%-5d %6zu  %-12s %10.1f %10.1f %10.0f %10.0f %8.1f %8.1f\n",
+                            r.width,
+                            r.height,
+                            r.points,
+                            cost_names[c],
+                            cost.Percentile(50.0),
+                            cost.Percentile(99.0),
+                            cost.vertices / frames,
+                            cost.indices / frames,
+                            cost.commands / frames,
+                            cost.allocations / frames);
+            }
+            std::fflush(stdout);
+        }
+    }
+
+    ImGui::DestroyContext();
+    if (!options.json_path.empty() && !write_json(options.json_path, options, results)) {
+        return 1;
+    }
+    return 0;
+}
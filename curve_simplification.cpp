@@ -0,0 +1,228 @@
+#include "curve_simplification.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+namespace ImTF {
+
+namespace {
+
+// The upper and lower convex hulls of the interior points of a range (a, b), kept as
+// two chains grown outward from a tag point t: the left chains hold the points t - 1
+// down to a + 1 and the right chains t up to b - 1. The point farthest above (below) a
+// line of slope m is on an upper (lower) chain where the chain's edges cross slope m.
+// Each push records the point it overwrote, so shrinking the range towards the tag
+// undoes the pushes of the dropped points in O(1) each
+class PathHull {
+    struct Chain {
+        std::vector<uint32_t> pts;
+        size_t size = 0;
+        // The size before each push and the point it overwrote
+        std::vector<std::pair<size_t, uint32_t>> history;
+    };
+
+    const float *x;
+    const float *y;
+    size_t tag = 0;
+    Chain left_upper;
+    Chain left_lower;
+    Chain right_upper;
+    Chain right_lower;
+
+public:
+    PathHull(const float *x, const float *y, size_t n) : x(x), y(y)
+    {
+        for (Chain *c : {&left_upper, &left_lower, &right_upper, &right_lower}) {
+            c->pts.resize(n);
+            c->history.reserve(n);
+        }
+    }
+
+    size_t Tag() const
+    {
+        return tag;
+    }
+
+    // Build the chains for the interior of (a, b) in linear time, the points are
+    // already sorted by x so each chain is a monotone chain
+    void Build(size_t a, size_t b)
+    {
+        tag = (a + b) / 2;
+        for (Chain *c : {&left_upper, &left_lower, &right_upper, &right_lower}) {
+            c->size = 0;
+            c->history.clear();
+        }
+        for (size_t i = tag; i-- > a + 1;) {
+            Push(left_upper, static_cast<uint32_t>(i), 1.0, -1.0);
+            Push(left_lower, static_cast<uint32_t>(i), -1.0, -1.0);
+        }
+        for (size_t i = tag; i < b; ++i) {
+            Push(right_upper, static_cast<uint32_t>(i), 1.0, 1.0);
+            Push(right_lower, static_cast<uint32_t>(i), -1.0, 1.0);
+        }
+    }
+
+    // Drop the count outermost points of the left (right) chains
+    void UndoLeft(size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            Undo(left_upper);
+            Undo(left_lower);
+        }
+    }
+
+    void UndoRight(size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            Undo(right_upper);
+            Undo(right_lower);
+        }
+    }
+
+    // Find the interior points maximizing and minimizing y - m * x
+    void Query(float m, uint32_t &max_pt, uint32_t &min_pt) const
+    {
+        bool has_max = false;
+        bool has_min = false;
+        Extreme(left_upper, m, 1.f, has_max, max_pt);
+        Extreme(right_upper, m, 1.f, has_max, max_pt);
+        Extreme(left_lower, m, -1.f, has_min, min_pt);
+        Extreme(right_lower, m, -1.f, has_min, min_pt);
+    }
+
+private:
+    double Cross(uint32_t o, uint32_t a, uint32_t b) const
+    {
+        return (double(x[a]) - x[o]) * (double(y[b]) - y[o]) -
+               (double(y[a]) - y[o]) * (double(x[b]) - x[o]);
+    }
+
+    float Value(uint32_t p, float m) const
+    {
+        return y[p] - m * x[p];
+    }
+
+    // Pop the points the new one makes concave, side is 1 for the upper chains and -1
+    // for the lower ones and dir is -1 for chains grown towards decreasing x. Of points
+    // at the same x only the highest (lowest) can be on the hull, which the turn test
+    // can't tell apart as they're collinear
+    void Push(Chain &c, uint32_t p, double side, double dir)
+    {
+        const size_t prev_size = c.size;
+        while (c.size >= 1) {
+            const uint32_t last = c.pts[c.size - 1];
+            const bool concave = x[last] == x[p]
+                                     ? side * (double(y[p]) - y[last]) >= 0.0
+                                     : c.size >= 2 &&
+                                           side * dir * Cross(c.pts[c.size - 2], last, p) >= 0.0;
+            if (!concave) {
+                break;
+            }
+            --c.size;
+        }
+        c.history.emplace_back(prev_size, c.pts[c.size]);
+        c.pts[c.size++] = p;
+    }
+
+    void Undo(Chain &c)
+    {
+        const std::pair<size_t, uint32_t> &h = c.history.back();
+        c.pts[--c.size] = h.second;
+        c.size = h.first;
+        c.history.pop_back();
+    }
+
+    // Binary search the chain for the extreme point, sign is 1 for the upper chains and
+    // -1 for the lower ones, along which the values are unimodal
+    void Extreme(const Chain &c, float m, float sign, bool &found, uint32_t &best) const
+    {
+        if (c.size == 0) {
+            return;
+        }
+        size_t lo = 0;
+        size_t hi = c.size - 1;
+        while (lo < hi) {
+            const size_t mid = (lo + hi) / 2;
+            if (sign * Value(c.pts[mid + 1], m) > sign * Value(c.pts[mid], m)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        const uint32_t p = c.pts[lo];
+        if (!found || sign * Value(p, m) > sign * Value(best, m)) {
+            best = p;
+            found = true;
+        }
+    }
+};
+
+}
+
+std::vector<size_t> SimplifyCurve(const float *x, const float *y, size_t n, float max_error)
+{
+    std::vector<size_t> kept;
+    if (n <= 2) {
+        for (size_t i = 0; i < n; ++i) {
+            kept.push_back(i);
+        }
+        return kept;
+    }
+
+    // Each range popped from the stack gets a fresh hull, the side of a split containing
+    // the hull's tag keeps it and continues right away while the other side is pushed.
+    // The pushed side lies on one side of the tag, which was the middle of a range
+    // containing it, so a point is in O(log n) builds and the total time is O(n log n)
+    PathHull hull(x, y, n);
+    std::vector<bool> keep(n, false);
+    keep[0] = keep[n - 1] = true;
+    std::vector<std::pair<size_t, size_t>> stack;
+    stack.emplace_back(0, n - 1);
+    while (!stack.empty()) {
+        size_t a = stack.back().first;
+        size_t b = stack.back().second;
+        stack.pop_back();
+        if (b <= a + 1) {
+            continue;
+        }
+
+        hull.Build(a, b);
+        while (b > a + 1) {
+            size_t split = a + 1;
+            if (x[b] > x[a]) {
+                const float m = (y[b] - y[a]) / (x[b] - x[a]);
+                const float base = y[a] - m * x[a];
+                uint32_t max_pt = 0;
+                uint32_t min_pt = 0;
+                hull.Query(m, max_pt, min_pt);
+                const float above = y[max_pt] - m * x[max_pt] - base;
+                const float below = base - (y[min_pt] - m * x[min_pt]);
+                if (std::max(above, below) <= max_error) {
+                    break;
+                }
+                split = above >= below ? max_pt : min_pt;
+            }
+            // Points stacked at the same x form a vertical step, which is kept as is
+            keep[split] = true;
+            if (split < hull.Tag()) {
+                stack.emplace_back(a, split);
+                hull.UndoLeft(split - a);
+                a = split;
+            } else {
+                stack.emplace_back(split, b);
+                hull.UndoRight(b - split);
+                b = split;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        if (keep[i]) {
+            kept.push_back(i);
+        }
+    }
+    return kept;
+}
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace ImTF {
+
+// Simplify the polyline through the n points (x[i], y[i]), sorted by x, with
+// Ramer-Douglas-Peucker using the vertical distance of the dropped points to the
+// simplified segments. Returns the indices of the points kept, which always include the
+// first and last, such that no dropped point is more than max_error above or below the
+// simplified polyline, which bounds the error of the whole curve between them. The
+// farthest point of each segment is found in O(log n) on convex hulls that are shared
+// with the subsegments, so the simplification takes O(n log n) even for curves RDP
+// handles in O(n^2)
+std::vector<size_t> SimplifyCurve(const float *x, const float *y, size_t n, float max_error);
+
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace ImTF {
+
+// A bounded undo/redo history of edits stored in a ring buffer. Edit is a delta which
+// can be applied in either direction by its owner and reports its size with Bytes().
+// When the history is over its entry or byte limit the oldest edits are dropped
+template <typename Edit>
+class EditHistory {
+    std::vector<Edit> ring;
+    size_t max_entries;
+    size_t max_bytes;
+    // Index of the oldest edit in the ring, the number of edits stored and how many
+    // of them are applied (the rest can be redone)
+    size_t head = 0;
+    size_t count = 0;
+    size_t cursor = 0;
+    size_t bytes = 0;
+
+public:
+    explicit EditHistory(size_t max_entries = 256, size_t max_bytes = size_t(1) << 20)
+        : max_entries(max_entries > 0 ? max_entries : 1), max_bytes(max_bytes)
+    {
+    }
+
+    // Record a new edit, dropping the edits that could be redone
+    void Push(Edit edit)
+    {
+        while (count > cursor) {
+            bytes -= At(count - 1).Bytes();
+            At(count - 1) = Edit();
+            --count;
+        }
+        if (ring.size() < max_entries) {
+            ring.resize(max_entries);
+        }
+        if (count == max_entries) {
+            DropOldest();
+        }
+        bytes += edit.Bytes();
+        At(count) = std::move(edit);
+        ++count;
+        cursor = count;
+        // Always keep the latest edit even if it's over the byte limit by itself
+        while (bytes > max_bytes && count > 1) {
+            DropOldest();
+        }
+    }
+
+    bool CanUndo() const
+    {
+        return cursor > 0;
+    }
+
+    bool CanRedo() const
+    {
+        return cursor < count;
+    }
+
+    // Step back over the last applied edit and return it to be reverted
+    const Edit &Undo()
+    {
+        --cursor;
+        return At(cursor);
+    }
+
+    // Step forward over the next undone edit and return it to be reapplied
+    const Edit &Redo()
+    {
+        ++cursor;
+        return At(cursor - 1);
+    }
+
+    void Clear()
+    {
+        ring.clear();
+        head = count = cursor = bytes = 0;
+    }
+
+    void SetLimits(size_t entries, size_t total_bytes)
+    {
+        // Keep the most recent edits which fit under the new limits
+        entries = entries > 0 ? entries : 1;
+        std::vector<Edit> edits;
+        const size_t first = count > entries ? count - entries : 0;
+        for (size_t i = first; i < count; ++i) {
+            edits.push_back(std::move(At(i)));
+        }
+        const size_t applied = cursor > first ? cursor - first : 0;
+        Clear();
+        max_entries = entries;
+        max_bytes = total_bytes;
+        for (auto &e : edits) {
+            Push(std::move(e));
+        }
+        // Pushing may drop more of the oldest edits to fit the byte limit
+        const size_t dropped = edits.size() - count;
+        cursor = applied > dropped ? applied - dropped : 0;
+    }
+
+    size_t Size() const
+    {
+        return count;
+    }
+
+    size_t Bytes() const
+    {
+        return bytes;
+    }
+
+private:
+    Edit &At(size_t i)
+    {
+        return ring[(head + i) % ring.size()];
+    }
+
+    void DropOldest()
+    {
+        bytes -= At(0).Bytes();
+        At(0) = Edit();
+        head = (head + 1) % ring.size();
+        --count;
+        cursor = cursor > 0 ? cursor - 1 : 0;
+    }
+};
+
+}
@@ -1,12 +1,14 @@
 #include <array>
 #include <iostream>
 #include <memory>
+#include <string>
 #include <vector>
 #include <SDL.h>
 #include "gl_core_4_5.h"
 #include "imgui.h"
 #include "imgui_impl_opengl3.h"
 #include "imgui_impl_sdl.h"
+#include "input_recording.h"
 #include "shader.h"
 #include "stb_image.h"
 #include "transfer_function_widget.h"
@@ -48,6 +50,13 @@ void main(void) {
 int win_width = 1280;
 int win_height = 720;
 
+// Recorded input is saved here, replay it with bench/tfn_replay
+const std::string recording_path = "tfn_recording.bin";
+// The window the widget is drawn in while recording. Mouse positions are recorded
+// relative to it, and tfn_replay lays the widget out in a window of the same size
+const ImVec2 recording_window_pos(400.f, 40.f);
+const ImVec2 recording_window_size(800.f, 600.f);
+
 void run_app(int argc, const char **argv, SDL_Window *window);
 
 int main(int argc, const char **argv)
@@ -83,6 +92,7 @@ int main(int argc, const char **argv)
         std::cerr << "Failed to initialize OpenGL\n";
         return 1;
     }
+    ImTF::SetOpenGLFunctionsLoaded();
 
     // Setup Dear ImGui context
     ImGui::CreateContext();
@@ -111,7 +121,10 @@ void run_app(int argc, const char **argv, SDL_Window *window)
 {
     ImGuiIO &io = ImGui::GetIO();
 
-    tfnw::TransferFunctionWidget tfn_widget;
+    ImTF::TransferFunctionWidget tfn_widget;
+    ImTF::InputRecorder recorder;
+    recorder.SetWindowSize(recording_window_size);
+    bool recording = false;
 
     // Load any extra colormaps the user wants to see in the demo
     for (int i = 1; i < argc; ++i) {
@@ -120,7 +133,7 @@ void run_app(int argc, const char **argv, SDL_Window *window)
         auto img = std::vector<uint8_t>(img_data, img_data + w * 1 * 4);
         stbi_image_free(img_data);
         // Input images are assumed to be sRGB color-space
-        tfn_widget.add_colormap(tfnw::Colormap(argv[i], img, tfnw::SRGB));
+        tfn_widget.AddColormap(ImTF::Colormap(argv[i], img, ImTF::SRGB));
     }
 
     // A texture so we can color the background of the window by the colormap
@@ -130,7 +143,7 @@ void run_app(int argc, const char **argv, SDL_Window *window)
     glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    auto colormap = tfn_widget.get_colormap();
+    auto colormap = tfn_widget.GetColormap();
     glTexImage1D(GL_TEXTURE_1D,
                  0,
                  GL_RGBA8,
@@ -176,8 +189,8 @@ void run_app(int argc, const char **argv, SDL_Window *window)
             }
         }
 
-        if (tfn_widget.changed()) {
-            auto colormap = tfn_widget.get_colormap();
+        if (tfn_widget.Changed()) {
+            auto colormap = tfn_widget.GetColormap();
             glTexImage1D(GL_TEXTURE_1D,
                          0,
                          GL_RGBA8,
@@ -191,14 +204,43 @@ void run_app(int argc, const char **argv, SDL_Window *window)
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplSDL2_NewFrame(window);
         ImGui::NewFrame();
+        if (recording) {
+            recorder.RecordFrame(io, recording_window_pos);
+        }
 
         ImGui::Begin("Debug Panel");
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                     1000.0f / ImGui::GetIO().Framerate,
                     ImGui::GetIO().Framerate);
-        tfn_widget.draw_ui();
+        if (ImGui::Checkbox("Record input", &recording)) {
+            if (recording) {
+                recorder.Clear();
+            } else if (recorder.Save(recording_path)) {
+                std::cout << "Saved " << recorder.NumFrames() << " frames of input to "
+                          << recording_path << "\n";
+            }
+        }
+        if (!recording) {
+            tfn_widget.DrawColorMap();
+            tfn_widget.DrawOpacityScale();
+            tfn_widget.DrawRanges();
+        }
         ImGui::End();
 
+        // While recording the widget is drawn with the layout tfn_replay uses, so the
+        // recorded mouse positions land on the same items when replayed
+        if (recording) {
+            ImGui::SetNextWindowPos(recording_window_pos);
+            ImGui::SetNextWindowSize(recording_window_size);
+            ImGui::Begin("Transfer Function",
+                         nullptr,
+                         ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoMove);
+            tfn_widget.DrawColorMap(false);
+            tfn_widget.DrawOpacityScale();
+            tfn_widget.DrawRanges();
+            ImGui::End();
+        }
+
         // Rendering
         ImGui::Render();
         glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
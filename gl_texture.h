@@ -0,0 +1,68 @@
+#pragma once
+
+#include "gl_core_4_5.h"
+
+namespace ImTF {
+
+// Owns an OpenGL texture name, which is deleted along with it, so the GL context the
+// texture was created in must be current when the owner is destroyed. Moving transfers
+// the texture and leaves the source without one
+class GLTexture {
+    GLuint id = -1;
+
+public:
+    GLTexture() = default;
+
+    GLTexture(const GLTexture &) = delete;
+    GLTexture &operator=(const GLTexture &) = delete;
+
+    GLTexture(GLTexture &&t) noexcept : id(t.id)
+    {
+        t.id = -1;
+    }
+
+    GLTexture &operator=(GLTexture &&t) noexcept
+    {
+        if (this != &t) {
+            Reset();
+            id = t.id;
+            t.id = -1;
+        }
+        return *this;
+    }
+
+    ~GLTexture()
+    {
+        Reset();
+    }
+
+    // Generate the texture name, if there isn't one yet
+    void Create()
+    {
+        if (!Valid()) {
+            glGenTextures(1, &id);
+        }
+    }
+
+    // Delete the texture, if there is one
+    void Reset()
+    {
+        if (Valid()) {
+            glDeleteTextures(1, &id);
+            id = -1;
+        }
+    }
+
+    bool Valid() const
+    {
+        return id != (GLuint)-1;
+    }
+
+    // The texture name, or -1 if there is none
+    GLuint Get() const
+    {
+        return id;
+    }
+};
+
+}
@@ -0,0 +1,69 @@
+#include "histogram.h"
+#include <cmath>
+
+namespace ImTF {
+
+bool Histogram::Empty() const
+{
+    return bins.empty();
+}
+
+uint64_t Histogram::TotalCount() const
+{
+    uint64_t total = 0;
+    for (const auto &b : bins) {
+        total += b;
+    }
+    return total;
+}
+
+std::vector<float> Histogram::Rebin(float lo, float hi, size_t num_bins) const
+{
+    std::vector<float> coarse(num_bins, 0.f);
+    if (bins.empty() || num_bins == 0 || !(hi > lo)) {
+        return coarse;
+    }
+
+    // All the data is a single value, it lands in one coarse bin
+    if (!(max > min)) {
+        if (min >= lo && min <= hi) {
+            const size_t b = std::min(static_cast<size_t>((min - lo) / (hi - lo) * num_bins),
+                                      num_bins - 1);
+            coarse[b] = static_cast<float>(TotalCount());
+        }
+        return coarse;
+    }
+
+    const double fine_width = (static_cast<double>(max) - min) / bins.size();
+    const double coarse_width = (static_cast<double>(hi) - lo) / num_bins;
+    // Only the fine bins overlapping [lo, hi] contribute
+    const size_t first =
+        static_cast<size_t>(std::max(std::floor((lo - min) / fine_width), 0.0));
+    const size_t last = static_cast<size_t>(
+        std::min(std::ceil((hi - min) / fine_width), static_cast<double>(bins.size())));
+    for (size_t f = first; f < last; ++f) {
+        if (bins[f] == 0) {
+            continue;
+        }
+        const double f0 = min + f * fine_width;
+        const double f1 = f0 + fine_width;
+        // Spread the fine bin's count over the coarse bins it overlaps
+        const double c0 = (std::max(f0, static_cast<double>(lo)) - lo) / coarse_width;
+        const double c1 = (std::min(f1, static_cast<double>(hi)) - lo) / coarse_width;
+        for (size_t c = static_cast<size_t>(c0); c < num_bins && c < c1; ++c) {
+            const double overlap = std::min(c1, c + 1.0) - std::max(c0, static_cast<double>(c));
+            coarse[c] += static_cast<float>(bins[f] * overlap * coarse_width / fine_width);
+        }
+    }
+    return coarse;
+}
+
+void Histogram::Merge(const Histogram &b)
+{
+    if (b.bins.size() != bins.size()) {
+        return;
+    }
+    AddBins(bins.data(), b.bins.data(), bins.size());
+}
+
+}
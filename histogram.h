@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <limits>
+#include <vector>
+#include "thread_pool.h"
+
+namespace ImTF {
+
+// A fine-grained histogram of a dataset over its value range. Coarser histograms
+// over any sub-range are re-binned from it without rescanning the data
+struct Histogram {
+    // The range of the data, bins evenly divide [min, max]
+    float min = 0.f;
+    float max = 0.f;
+    std::vector<uint64_t> bins;
+
+    bool Empty() const;
+
+    uint64_t TotalCount() const;
+
+    // Re-bin the counts falling in [lo, hi] into num_bins bins. Fine bins partially
+    // covered by a coarse bin contribute proportionally to their overlap
+    std::vector<float> Rebin(float lo, float hi, size_t num_bins) const;
+
+    // Add the counts of another histogram with the same range and number of bins
+    void Merge(const Histogram &b);
+};
+
+// Add the counts in b to a, a simple loop the compiler vectorizes
+inline void AddBins(uint64_t *a, const uint64_t *b, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        a[i] += b[i];
+    }
+}
+
+// Compute a histogram of count values read with the given stride (in elements),
+// NaNs are skipped. The data is split into chunks processed in parallel on
+// num_threads threads (0 for one per hardware thread), each with its own private
+// bins which are merged at the end
+template <typename T>
+Histogram ComputeHistogram(const T *data,
+                           size_t count,
+                           size_t stride = 1,
+                           size_t num_bins = 4096,
+                           unsigned num_threads = 0)
+{
+    Histogram hist;
+    if (count == 0 || num_bins == 0) {
+        return hist;
+    }
+
+    ThreadPool pool(num_threads);
+    const size_t num_chunks = std::min(count, pool.Size() * 4);
+    const size_t chunk_size = (count + num_chunks - 1) / num_chunks;
+    auto run_chunks = [&](const std::function<void(size_t, size_t, size_t)> &fn) {
+        std::vector<std::future<void>> done;
+        for (size_t c = 0; c < num_chunks; ++c) {
+            const size_t begin = c * chunk_size;
+            const size_t end = std::min(count, begin + chunk_size);
+            if (begin < end) {
+                done.push_back(pool.Submit([&fn, c, begin, end]() { fn(c, begin, end); }));
+            }
+        }
+        for (auto &d : done) {
+            d.get();
+        }
+    };
+
+    // Find the value range
+    std::vector<float> chunk_min(num_chunks, std::numeric_limits<float>::max());
+    std::vector<float> chunk_max(num_chunks, std::numeric_limits<float>::lowest());
+    run_chunks([&](size_t c, size_t begin, size_t end) {
+        float lo = chunk_min[c];
+        float hi = chunk_max[c];
+        for (size_t i = begin; i < end; ++i) {
+            const float v = static_cast<float>(data[i * stride]);
+            // Comparisons with NaN are false, so they're skipped
+            lo = v < lo ? v : lo;
+            hi = v > hi ? v : hi;
+        }
+        chunk_min[c] = lo;
+        chunk_max[c] = hi;
+    });
+    hist.min = *std::min_element(chunk_min.begin(), chunk_min.end());
+    hist.max = *std::max_element(chunk_max.begin(), chunk_max.end());
+    hist.bins.resize(num_bins, 0);
+    if (hist.min > hist.max) {
+        // Only NaNs
+        hist.min = hist.max = 0.f;
+        return hist;
+    }
+
+    // Bin into per-chunk private histograms, then merge them
+    const float scale = hist.max > hist.min ? num_bins / (hist.max - hist.min) : 0.f;
+    const float max_bin = static_cast<float>(num_bins - 1);
+    std::vector<std::vector<uint64_t>> chunk_bins(num_chunks);
+    run_chunks([&](size_t c, size_t begin, size_t end) {
+        std::vector<uint64_t> &bins = chunk_bins[c];
+        bins.resize(num_bins, 0);
+        for (size_t i = begin; i < end; ++i) {
+            const float v = static_cast<float>(data[i * stride]);
+            if (v != v) {
+                continue;
+            }
+            float b = (v - hist.min) * scale;
+            b = b < max_bin ? b : max_bin;
+            ++bins[static_cast<size_t>(b)];
+        }
+    });
+    for (const auto &bins : chunk_bins) {
+        if (!bins.empty()) {
+            AddBins(hist.bins.data(), bins.data(), num_bins);
+        }
+    }
+    return hist;
+}
+}
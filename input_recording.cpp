@@ -0,0 +1,323 @@
+#include "input_recording.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace ImTF {
+
+namespace {
+
+const char recording_magic[4] = {'T', 'F', 'N', 'I'};
+const uint32_t recording_version = 1;
+
+// Each frame starts with a byte of flags for the fields stored in it, fields not stored
+// are unchanged from the previous frame, except for the wheel and characters, which are
+// zero and empty
+enum FrameFields {
+    FIELD_DELTA_TIME = 1 << 0,
+    FIELD_MOUSE_POS = 1 << 1,
+    FIELD_MOUSE_BUTTONS = 1 << 2,
+    FIELD_MOUSE_WHEEL = 1 << 3,
+    FIELD_KEYS = 1 << 4,
+    FIELD_CHARACTERS = 1 << 5
+};
+
+// Little-endian binary writing and reading
+void write_u32(std::ostream &out, uint32_t v)
+{
+    const char bytes[4] = {char(v), char(v >> 8), char(v >> 16), char(v >> 24)};
+    out.write(bytes, 4);
+}
+
+void write_u16(std::ostream &out, uint16_t v)
+{
+    const char bytes[2] = {char(v), char(v >> 8)};
+    out.write(bytes, 2);
+}
+
+void write_f32(std::ostream &out, float v)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    write_u32(out, bits);
+}
+
+bool read_u32(std::istream &in, uint32_t &v)
+{
+    unsigned char bytes[4];
+    if (!in.read(reinterpret_cast<char *>(bytes), 4)) {
+        return false;
+    }
+    v = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (uint32_t(bytes[3]) << 24);
+    return true;
+}
+
+bool read_u16(std::istream &in, uint16_t &v)
+{
+    unsigned char bytes[2];
+    if (!in.read(reinterpret_cast<char *>(bytes), 2)) {
+        return false;
+    }
+    v = static_cast<uint16_t>(bytes[0] | (bytes[1] << 8));
+    return true;
+}
+
+bool read_f32(std::istream &in, float &v)
+{
+    uint32_t bits;
+    if (!read_u32(in, bits)) {
+        return false;
+    }
+    std::memcpy(&v, &bits, sizeof(v));
+    return true;
+}
+
+}
+
+void InputRecorder::RecordFrame(const ImGuiIO &io, ImVec2 origin)
+{
+    InputFrame frame;
+    frame.delta_time = io.DeltaTime;
+    frame.mouse_pos = ImVec2(io.MousePos.x - origin.x, io.MousePos.y - origin.y);
+    for (int i = 0; i < 5; ++i) {
+        if (io.MouseDown[i]) {
+            frame.mouse_buttons |= 1 << i;
+        }
+    }
+    frame.mouse_wheel = ImVec2(io.MouseWheelH, io.MouseWheel);
+    for (int key = ImGuiKey_NamedKey_BEGIN; key < ImGuiKey_NamedKey_END; ++key) {
+        if (io.KeysData[key - ImGuiKey_KeysData_OFFSET].Down) {
+            frame.keys_down.push_back(static_cast<uint16_t>(key));
+        }
+    }
+    frame.characters.assign(io.InputQueueCharacters.begin(), io.InputQueueCharacters.end());
+    frames.push_back(std::move(frame));
+}
+
+void InputRecorder::AddFrame(const InputFrame &frame)
+{
+    frames.push_back(frame);
+}
+
+void InputRecorder::SetWindowSize(ImVec2 size)
+{
+    window_size = size;
+}
+
+void InputRecorder::Clear()
+{
+    frames.clear();
+}
+
+size_t InputRecorder::NumFrames() const
+{
+    return frames.size();
+}
+
+bool InputRecorder::Save(const std::string &filepath) const
+{
+    std::ofstream out(filepath, std::ios::binary);
+    if (!out) {
+        std::cerr << "Failed to open " << filepath << " for writing\n";
+        return false;
+    }
+    out.write(recording_magic, sizeof(recording_magic));
+    write_u32(out, recording_version);
+    write_f32(out, window_size.x);
+    write_f32(out, window_size.y);
+    write_u32(out, static_cast<uint32_t>(frames.size()));
+
+    InputFrame prev;
+    for (const auto &f : frames) {
+        uint8_t fields = 0;
+        if (f.delta_time != prev.delta_time) {
+            fields |= FIELD_DELTA_TIME;
+        }
+        if (f.mouse_pos.x != prev.mouse_pos.x || f.mouse_pos.y != prev.mouse_pos.y) {
+            fields |= FIELD_MOUSE_POS;
+        }
+        if (f.mouse_buttons != prev.mouse_buttons) {
+            fields |= FIELD_MOUSE_BUTTONS;
+        }
+        if (f.mouse_wheel.x != 0.f || f.mouse_wheel.y != 0.f) {
+            fields |= FIELD_MOUSE_WHEEL;
+        }
+        if (f.keys_down != prev.keys_down) {
+            fields |= FIELD_KEYS;
+        }
+        if (!f.characters.empty()) {
+            fields |= FIELD_CHARACTERS;
+        }
+
+        out.put(static_cast<char>(fields));
+        if (fields & FIELD_DELTA_TIME) {
+            write_f32(out, f.delta_time);
+        }
+        if (fields & FIELD_MOUSE_POS) {
+            write_f32(out, f.mouse_pos.x);
+            write_f32(out, f.mouse_pos.y);
+        }
+        if (fields & FIELD_MOUSE_BUTTONS) {
+            out.put(static_cast<char>(f.mouse_buttons));
+        }
+        if (fields & FIELD_MOUSE_WHEEL) {
+            write_f32(out, f.mouse_wheel.x);
+            write_f32(out, f.mouse_wheel.y);
+        }
+        if (fields & FIELD_KEYS) {
+            write_u16(out, static_cast<uint16_t>(f.keys_down.size()));
+            for (const auto &k : f.keys_down) {
+                write_u16(out, k);
+            }
+        }
+        if (fields & FIELD_CHARACTERS) {
+            write_u16(out, static_cast<uint16_t>(f.characters.size()));
+            for (const auto &c : f.characters) {
+                write_u32(out, c);
+            }
+        }
+        prev = f;
+    }
+    if (!out) {
+        std::cerr << "Failed to write the input recording " << filepath << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool InputReplay::Load(const std::string &filepath)
+{
+    std::ifstream in(filepath, std::ios::binary);
+    if (!in) {
+        std::cerr << "Failed to open " << filepath << " for reading\n";
+        return false;
+    }
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t count = 0;
+    ImVec2 size;
+    if (!in.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, recording_magic, sizeof(magic)) != 0 || !read_u32(in, version) ||
+        version != recording_version || !read_f32(in, size.x) || !read_f32(in, size.y) ||
+        !read_u32(in, count)) {
+        std::cerr << filepath << " is not a supported input recording\n";
+        return false;
+    }
+
+    std::vector<InputFrame> loaded;
+    loaded.reserve(count);
+    InputFrame f;
+    for (uint32_t i = 0; i < count; ++i) {
+        const int fields = in.get();
+        if (fields == EOF) {
+            std::cerr << "Input recording " << filepath << " is truncated\n";
+            return false;
+        }
+        f.mouse_wheel = ImVec2(0.f, 0.f);
+        f.characters.clear();
+        bool ok = true;
+        if (fields & FIELD_DELTA_TIME) {
+            ok = ok && read_f32(in, f.delta_time);
+        }
+        if (fields & FIELD_MOUSE_POS) {
+            ok = ok && read_f32(in, f.mouse_pos.x) && read_f32(in, f.mouse_pos.y);
+        }
+        if (fields & FIELD_MOUSE_BUTTONS) {
+            const int buttons = in.get();
+            ok = ok && buttons != EOF;
+            f.mouse_buttons = static_cast<uint8_t>(buttons);
+        }
+        if (fields & FIELD_MOUSE_WHEEL) {
+            ok = ok && read_f32(in, f.mouse_wheel.x) && read_f32(in, f.mouse_wheel.y);
+        }
+        if (fields & FIELD_KEYS) {
+            uint16_t n = 0;
+            ok = ok && read_u16(in, n);
+            f.keys_down.resize(ok ? n : 0);
+            for (auto &k : f.keys_down) {
+                ok = ok && read_u16(in, k);
+            }
+        }
+        if (fields & FIELD_CHARACTERS) {
+            uint16_t n = 0;
+            ok = ok && read_u16(in, n);
+            f.characters.resize(ok ? n : 0);
+            for (auto &c : f.characters) {
+                ok = ok && read_u32(in, c);
+            }
+        }
+        if (!ok) {
+            std::cerr << "Input recording " << filepath << " is truncated\n";
+            return false;
+        }
+        loaded.push_back(f);
+    }
+
+    frames.swap(loaded);
+    window_size = size;
+    applied = InputFrame();
+    return true;
+}
+
+size_t InputReplay::NumFrames() const
+{
+    return frames.size();
+}
+
+const InputFrame &InputReplay::Frame(size_t i) const
+{
+    return frames[i];
+}
+
+ImVec2 InputReplay::WindowSize() const
+{
+    return window_size;
+}
+
+void InputReplay::ApplyFrame(size_t i, ImGuiIO &io, ImVec2 origin)
+{
+    if (i >= frames.size()) {
+        return;
+    }
+    // Replaying from the start again, release everything held at the end
+    if (i == 0) {
+        applied.mouse_buttons = 0x1F;
+        applied.keys_down.clear();
+        for (int key = ImGuiKey_NamedKey_BEGIN; key < ImGuiKey_NamedKey_END; ++key) {
+            applied.keys_down.push_back(static_cast<uint16_t>(key));
+        }
+    }
+    const InputFrame &f = frames[i];
+    io.DeltaTime = f.delta_time;
+    io.AddMousePosEvent(f.mouse_pos.x + origin.x, f.mouse_pos.y + origin.y);
+    for (int b = 0; b < 5; ++b) {
+        const bool down = (f.mouse_buttons >> b) & 1;
+        if (down != bool((applied.mouse_buttons >> b) & 1)) {
+            io.AddMouseButtonEvent(b, down);
+        }
+    }
+    if (f.mouse_wheel.x != 0.f || f.mouse_wheel.y != 0.f) {
+        io.AddMouseWheelEvent(f.mouse_wheel.x, f.mouse_wheel.y);
+    }
+    // Both lists are sorted, so walk them together to find the keys which changed
+    auto released = applied.keys_down.begin();
+    auto pressed = f.keys_down.begin();
+    while (released != applied.keys_down.end() || pressed != f.keys_down.end()) {
+        if (pressed == f.keys_down.end() ||
+            (released != applied.keys_down.end() && *released < *pressed)) {
+            io.AddKeyEvent(static_cast<ImGuiKey>(*released++), false);
+        } else if (released == applied.keys_down.end() || *pressed < *released) {
+            io.AddKeyEvent(static_cast<ImGuiKey>(*pressed++), true);
+        } else {
+            ++released;
+            ++pressed;
+        }
+    }
+    for (const auto &c : f.characters) {
+        io.AddInputCharacter(c);
+    }
+    applied = f;
+}
+
+}
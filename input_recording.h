@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "imgui.h"
+
+namespace ImTF {
+
+// The mouse and keyboard input of one ImGui frame. Mouse positions are relative to the
+// origin given when recording or replaying, e.g. the window holding the widget
+struct InputFrame {
+    float delta_time = 1.f / 60.f;
+    ImVec2 mouse_pos = ImVec2(0.f, 0.f);
+    // Bit i is set if mouse button i is down
+    uint8_t mouse_buttons = 0;
+    ImVec2 mouse_wheel = ImVec2(0.f, 0.f);
+    // The named keys (ImGuiKey) down in the frame, in increasing order
+    std::vector<uint16_t> keys_down;
+    // Text input characters
+    std::vector<uint32_t> characters;
+};
+
+// Records the ImGui mouse and keyboard input of an editing session, to replay it with
+// InputReplay. Call RecordFrame every frame after ImGui::NewFrame, once the frame's input
+// has been processed. Recordings are stored compactly, a frame whose input didn't change
+// from the last takes one byte
+class InputRecorder {
+    std::vector<InputFrame> frames;
+    ImVec2 window_size = ImVec2(0.f, 0.f);
+
+public:
+    // Record the input of the current frame, with mouse positions relative to origin
+    void RecordFrame(const ImGuiIO &io, ImVec2 origin = ImVec2(0.f, 0.f));
+
+    // Add a frame of input, e.g. to script an interaction
+    void AddFrame(const InputFrame &frame);
+
+    // Set the size of the window the widget was drawn in, stored with the recording so
+    // the replay can lay out the widget the same way
+    void SetWindowSize(ImVec2 size);
+
+    void Clear();
+
+    size_t NumFrames() const;
+
+    bool Save(const std::string &filepath) const;
+};
+
+// Replays a recording made by InputRecorder. Input is queued frame by frame through the
+// io.Add*Event functions before ImGui::NewFrame. Disable io.ConfigInputTrickleEventQueue
+// when replaying, the recording already holds the input ImGui saw in each frame
+class InputReplay {
+    std::vector<InputFrame> frames;
+    ImVec2 window_size = ImVec2(0.f, 0.f);
+    // The input state last queued, to only queue what changed
+    InputFrame applied;
+
+public:
+    bool Load(const std::string &filepath);
+
+    size_t NumFrames() const;
+
+    const InputFrame &Frame(size_t i) const;
+
+    // The size of the window the recording was made in, zero if it wasn't set
+    ImVec2 WindowSize() const;
+
+    // Queue the input of frame i into io, with mouse positions relative to origin, and
+    // set its delta time. Frames should be applied in order from the first
+    void ApplyFrame(size_t i, ImGuiIO &io, ImVec2 origin = ImVec2(0.f, 0.f));
+};
+
+}
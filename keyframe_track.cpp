@@ -0,0 +1,240 @@
+#include "keyframe_track.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace ImTF {
+
+namespace {
+
+float lerp(float a, float b, float t)
+{
+    return a + (b - a) * t;
+}
+
+CurveSegments state_segments(const TransferFunctionState &state)
+{
+    CurveSegments segments;
+    const size_t n = std::min(state.control_x.size(), state.control_y.size());
+    std::vector<InterpolationMode> modes(state.modes);
+    modes.resize(n, INTERP_LINEAR);
+    ComputeCurveSegments(state.control_x.data(), state.control_y.data(), modes.data(), n, segments);
+    return segments;
+}
+
+// Linearly resample the RGB of an RGBA8 table to n entries
+void resample_colors(const std::vector<uint8_t> &colors, size_t n, std::vector<float> &out)
+{
+    out.assign(n * 3, 0.f);
+    const size_t src_n = colors.size() / 4;
+    if (src_n == 0) {
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const float x = n > 1 ? static_cast<float>(i) / (n - 1) * (src_n - 1) : 0.f;
+        const size_t a = std::min(static_cast<size_t>(x), src_n - 1);
+        const size_t b = std::min(a + 1, src_n - 1);
+        const float t = x - a;
+        for (size_t c = 0; c < 3; ++c) {
+            out[i * 3 + c] = lerp(colors[a * 4 + c], colors[b * 4 + c], t);
+        }
+    }
+}
+
+uint32_t time_key(float time)
+{
+    uint32_t key;
+    std::memcpy(&key, &time, sizeof(key));
+    return key;
+}
+
+}
+
+KeyframeTrack::KeyframeTrack(size_t table_size, size_t cache_capacity)
+    : table_size(table_size), cache_capacity(cache_capacity)
+{
+}
+
+void KeyframeTrack::AddKeyframe(float time, const TransferFunctionState &state)
+{
+    auto fnd = std::lower_bound(keyframes.begin(),
+                                keyframes.end(),
+                                time,
+                                [](const Keyframe &k, float t) { return k.time < t; });
+    if (fnd != keyframes.end() && fnd->time == time) {
+        fnd->state = state;
+    } else {
+        keyframes.insert(fnd, Keyframe{time, state});
+    }
+    ClearCache();
+}
+
+void KeyframeTrack::RemoveKeyframe(size_t i)
+{
+    if (i < keyframes.size()) {
+        keyframes.erase(keyframes.begin() + i);
+        ClearCache();
+    }
+}
+
+void KeyframeTrack::Clear()
+{
+    keyframes.clear();
+    ClearCache();
+}
+
+size_t KeyframeTrack::NumKeyframes() const
+{
+    return keyframes.size();
+}
+
+float KeyframeTrack::KeyframeTime(size_t i) const
+{
+    return keyframes[i].time;
+}
+
+const TransferFunctionState &KeyframeTrack::GetKeyframe(size_t i) const
+{
+    return keyframes[i].state;
+}
+
+TransferFunctionState KeyframeTrack::Evaluate(float time) const
+{
+    if (keyframes.empty()) {
+        return TransferFunctionState();
+    }
+    if (time <= keyframes.front().time) {
+        return keyframes.front().state;
+    }
+    if (time >= keyframes.back().time) {
+        return keyframes.back().state;
+    }
+    auto next = std::upper_bound(keyframes.begin(),
+                                 keyframes.end(),
+                                 time,
+                                 [](float t, const Keyframe &k) { return t < k.time; });
+    const Keyframe &ka = *(next - 1);
+    const Keyframe &kb = *next;
+    const float t = (time - ka.time) / (kb.time - ka.time);
+    const TransferFunctionState &a = ka.state;
+    const TransferFunctionState &b = kb.state;
+
+    TransferFunctionState s;
+    s.range_min = lerp(a.range_min, b.range_min, t);
+    s.range_max = lerp(a.range_max, b.range_max, t);
+    s.opacity_scale = lerp(a.opacity_scale, b.opacity_scale, t);
+
+    // Evaluate both curves at the union of their control points and blend them, the
+    // segments take the interpolation of the nearer keyframe
+    const CurveSegments seg_a = state_segments(a);
+    const CurveSegments seg_b = state_segments(b);
+    const TransferFunctionState &nearer = t < 0.5f ? a : b;
+    std::vector<float> xs(a.control_x);
+    xs.insert(xs.end(), b.control_x.begin(), b.control_x.end());
+    std::sort(xs.begin(), xs.end());
+    xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+    for (const auto &x : xs) {
+        s.control_x.push_back(x);
+        s.control_y.push_back(lerp(EvaluateCurve(seg_a, x), EvaluateCurve(seg_b, x), t));
+        // The mode of the nearer keyframe's segment starting at or containing x
+        size_t seg = std::upper_bound(nearer.control_x.begin(), nearer.control_x.end(), x) -
+                     nearer.control_x.begin();
+        seg = seg > 0 ? seg - 1 : 0;
+        s.modes.push_back(seg < nearer.modes.size() ? nearer.modes[seg] : INTERP_LINEAR);
+    }
+
+    // Blend the colors, resampled to the larger of the two tables
+    const size_t n = std::max(a.colors.size(), b.colors.size()) / 4;
+    std::vector<float> ca;
+    std::vector<float> cb;
+    resample_colors(a.colors, n, ca);
+    resample_colors(b.colors, n, cb);
+    s.colors.resize(n * 4);
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t c = 0; c < 3; ++c) {
+            const float v = lerp(ca[i * 3 + c], cb[i * 3 + c], t);
+            s.colors[i * 4 + c] = static_cast<uint8_t>(std::min(std::max(v + 0.5f, 0.f), 255.f));
+        }
+        s.colors[i * 4 + 3] = 255;
+    }
+    return s;
+}
+
+std::vector<uint8_t> KeyframeTrack::BuildTable(const TransferFunctionState &state) const
+{
+    const size_t n = table_size > 0 ? table_size : state.colors.size() / 4;
+    std::vector<uint8_t> table(n * 4, 0);
+    std::vector<float> colors;
+    resample_colors(state.colors, n, colors);
+    std::vector<float> opacity(n);
+    SampleCurve(state_segments(state), n, opacity.data());
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t c = 0; c < 3; ++c) {
+            table[i * 4 + c] = static_cast<uint8_t>(std::min(colors[i * 3 + c] + 0.5f, 255.f));
+        }
+        const float a = opacity[i] * state.opacity_scale * 255.f;
+        table[i * 4 + 3] = static_cast<uint8_t>(std::min(std::max(a, 0.f), 255.f));
+    }
+    return table;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> KeyframeTrack::GetTable(float time)
+{
+    const uint32_t key = time_key(time);
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto fnd = cache_index.find(key);
+        if (fnd != cache_index.end()) {
+            ++cache_hits;
+            cache_lru.splice(cache_lru.begin(), cache_lru, fnd->second);
+            return fnd->second->second;
+        }
+        ++cache_misses;
+    }
+
+    // Build outside the lock so other threads can read cached tables meanwhile
+    auto table = std::make_shared<const std::vector<uint8_t>>(BuildTable(Evaluate(time)));
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (cache_capacity == 0 || cache_index.count(key)) {
+        return table;
+    }
+    cache_lru.emplace_front(key, table);
+    cache_index[key] = cache_lru.begin();
+    while (cache_lru.size() > cache_capacity) {
+        cache_index.erase(cache_lru.back().first);
+        cache_lru.pop_back();
+    }
+    return table;
+}
+
+void KeyframeTrack::SetCacheCapacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache_capacity = capacity;
+    while (cache_lru.size() > cache_capacity) {
+        cache_index.erase(cache_lru.back().first);
+        cache_lru.pop_back();
+    }
+}
+
+void KeyframeTrack::ClearCache()
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache_lru.clear();
+    cache_index.clear();
+}
+
+uint64_t KeyframeTrack::CacheHits() const
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return cache_hits;
+}
+
+uint64_t KeyframeTrack::CacheMisses() const
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return cache_misses;
+}
+
+}
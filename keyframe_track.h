@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "opacity_curve.h"
+
+namespace ImTF {
+
+// A snapshot of a 1D transfer function's state, see TransferFunctionWidget::GetState
+struct TransferFunctionState {
+    // The opacity control points, sorted by x, and the interpolation of the segment
+    // starting at each one
+    std::vector<float> control_x;
+    std::vector<float> control_y;
+    std::vector<InterpolationMode> modes;
+    // The relative range of the data the transfer function covers
+    float range_min = 0.f;
+    float range_max = 1.f;
+    float opacity_scale = 1.f;
+    // The RGBA8 colors of the colormap, the alpha values are ignored
+    std::vector<uint8_t> colors;
+};
+
+// A track of transfer function keyframes which can be evaluated at any time in between.
+// Control points, range, opacity scale and colors are interpolated linearly between the
+// keyframes around the time. The RGBA8 tables built for the times requested are kept in
+// an LRU cache, so scrubbing back and forth over a sequence doesn't rebuild them
+class KeyframeTrack {
+    struct Keyframe {
+        float time;
+        TransferFunctionState state;
+    };
+    std::vector<Keyframe> keyframes;
+    size_t table_size;
+
+    // The cached tables by the bits of their time, most recently used first
+    using CachedTable = std::pair<uint32_t, std::shared_ptr<const std::vector<uint8_t>>>;
+    mutable std::mutex cache_mutex;
+    std::list<CachedTable> cache_lru;
+    std::unordered_map<uint32_t, std::list<CachedTable>::iterator> cache_index;
+    size_t cache_capacity;
+    uint64_t cache_hits = 0;
+    uint64_t cache_misses = 0;
+
+public:
+    // Tables have table_size RGBA8 entries, or as many as the keyframes' colormaps if 0,
+    // at most cache_capacity of them are cached
+    explicit KeyframeTrack(size_t table_size = 0, size_t cache_capacity = 64);
+
+    // Add a keyframe at time, replacing any keyframe already at that time
+    void AddKeyframe(float time, const TransferFunctionState &state);
+
+    void RemoveKeyframe(size_t i);
+
+    void Clear();
+
+    size_t NumKeyframes() const;
+
+    float KeyframeTime(size_t i) const;
+
+    const TransferFunctionState &GetKeyframe(size_t i) const;
+
+    // The interpolated state at time. Before the first or after the last keyframe the
+    // state of that keyframe is returned. The control points are the union of those of
+    // the two keyframes, which is exact when both keyframes are piecewise linear
+    TransferFunctionState Evaluate(float time) const;
+
+    // The RGBA8 table of the interpolated state at time, from the cache if it was
+    // built before. Safe to call from multiple threads
+    std::shared_ptr<const std::vector<uint8_t>> GetTable(float time);
+
+    // Build the RGBA8 table of a state
+    std::vector<uint8_t> BuildTable(const TransferFunctionState &state) const;
+
+    void SetCacheCapacity(size_t capacity);
+
+    void ClearCache();
+
+    uint64_t CacheHits() const;
+    uint64_t CacheMisses() const;
+};
+
+}
@@ -0,0 +1,200 @@
+#include "multi_channel_transfer_function.h"
+#include <algorithm>
+#include <iostream>
+#include "table_lookup.h"
+#include "trace.h"
+
+namespace ImTF {
+
+MultiChannelTransferFunction::MultiChannelTransferFunction(int width, Packing packing, bool noGui)
+    : width(std::max(width, 1)), packing(packing), noGui(noGui)
+{
+}
+
+size_t MultiChannelTransferFunction::AddChannel(const std::string &name,
+                                                float data_min,
+                                                float data_max)
+{
+    Channel c;
+    c.name = name;
+    c.widget.reset(new TransferFunctionWidget(noGui));
+    c.data_min = data_min;
+    c.data_max = data_max;
+    channels.push_back(std::move(c));
+    packed.resize(channels.size() * width * 4, 0);
+    return channels.size() - 1;
+}
+
+size_t MultiChannelTransferFunction::NumChannels() const
+{
+    return channels.size();
+}
+
+TransferFunctionWidget &MultiChannelTransferFunction::GetChannel(size_t i)
+{
+    return *channels[i].widget;
+}
+
+void MultiChannelTransferFunction::SetDataRange(size_t i, float data_min, float data_max)
+{
+    channels[i].data_min = data_min;
+    channels[i].data_max = data_max;
+}
+
+void MultiChannelTransferFunction::DrawColorMap(bool show_help)
+{
+    if (noGui) {
+        std::cerr << "MultiChannelTransferFunction::DrawColorMap() called with noGui set to true\n";
+        return;
+    }
+    if (channels.empty()) {
+        return;
+    }
+    selected_channel = std::min(selected_channel, channels.size() - 1);
+    if (ImGui::BeginCombo("Channel", channels[selected_channel].name.c_str())) {
+        for (size_t i = 0; i < channels.size(); ++i) {
+            if (ImGui::Selectable(channels[i].name.c_str(), selected_channel == i)) {
+                selected_channel = i;
+            }
+        }
+        ImGui::EndCombo();
+    }
+    // Each channel's widgets need their own ID scope since they share labels
+    ImGui::PushID(static_cast<int>(selected_channel));
+    channels[selected_channel].widget->DrawColorMap(show_help);
+    ImGui::PopID();
+}
+
+bool MultiChannelTransferFunction::Update()
+{
+    bool changed = false;
+    for (size_t i = 0; i < channels.size(); ++i) {
+        Channel &c = channels[i];
+        // Pack the published tables, so the channel's update policy applies to the texture
+        const TransferFunctionWidget::SnapshotHandle snapshot =
+            c.widget->AcquireColormapSnapshot();
+        if (c.packed_version == snapshot->version) {
+            continue;
+        }
+        c.packed_version = snapshot->version;
+
+        // Resample the channel's table to the packed width, sampling at texel centers
+        const std::vector<uint8_t> &table = snapshot->rgba;
+        const size_t src_width = table.size() / 4;
+        uint8_t *row = packed.data() + i * width * 4;
+        if (src_width == static_cast<size_t>(width)) {
+            std::copy(table.begin(), table.end(), row);
+        } else if (src_width > 0) {
+            for (int x = 0; x < width; ++x) {
+                const size_t src = std::min(
+                    static_cast<size_t>((x + 0.5f) * src_width / width), src_width - 1);
+                std::copy(table.begin() + src * 4, table.begin() + src * 4 + 4, row + x * 4);
+            }
+        }
+
+        if (gpu_dirty_begin == gpu_dirty_end) {
+            gpu_dirty_begin = i;
+            gpu_dirty_end = i + 1;
+        } else {
+            gpu_dirty_begin = std::min(gpu_dirty_begin, i);
+            gpu_dirty_end = std::max(gpu_dirty_end, i + 1);
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+void MultiChannelTransferFunction::UpdateGPUImage()
+{
+    if (noGui) {
+        std::cerr << "MultiChannelTransferFunction::UpdateGPUImage() called with noGui set to true\n";
+        return;
+    }
+    Update();
+    if (channels.empty()) {
+        return;
+    }
+
+    const GLenum target = packing == PACK_TEXTURE_ARRAY ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    GLint prev_tex = 0;
+    glGetIntegerv(
+        packing == PACK_TEXTURE_ARRAY ? GL_TEXTURE_BINDING_2D_ARRAY : GL_TEXTURE_BINDING_2D,
+        &prev_tex);
+
+    if (!texture.Valid()) {
+        texture.Create();
+        glBindTexture(target, texture.Get());
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(target, texture.Get());
+
+    const GLsizei layers = static_cast<GLsizei>(channels.size());
+    if (texture_layers != channels.size()) {
+        // Channels were added, reallocate the texture with all of them
+        texture_layers = channels.size();
+        if (packing == PACK_TEXTURE_ARRAY) {
+            glTexImage3D(target, 0, GL_RGBA8, width, 1, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                         packed.data());
+        } else {
+            glTexImage2D(target, 0, GL_RGBA8, width, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                         packed.data());
+        }
+    } else if (gpu_dirty_begin != gpu_dirty_end) {
+        // Upload the span of changed rows in one call
+        const GLint first = static_cast<GLint>(gpu_dirty_begin);
+        const GLsizei count = static_cast<GLsizei>(gpu_dirty_end - gpu_dirty_begin);
+        const uint8_t *data = packed.data() + gpu_dirty_begin * width * 4;
+        if (packing == PACK_TEXTURE_ARRAY) {
+            glTexSubImage3D(target, 0, 0, 0, first, width, 1, count, GL_RGBA, GL_UNSIGNED_BYTE,
+                            data);
+        } else {
+            glTexSubImage2D(target, 0, 0, first, width, count, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        }
+    }
+    gpu_dirty_begin = gpu_dirty_end = 0;
+    glBindTexture(target, prev_tex);
+}
+
+GLuint MultiChannelTransferFunction::GetTexture() const
+{
+    return texture.Get();
+}
+
+const std::vector<uint8_t> &MultiChannelTransferFunction::GetPackedColormaps() const
+{
+    return packed;
+}
+
+int MultiChannelTransferFunction::Width() const
+{
+    return width;
+}
+
+void MultiChannelTransferFunction::Classify(const float *voxels, size_t count, uint8_t *rgba)
+{
+    TFN_TRACE_ZONE("MultiChannelTransferFunction::Classify");
+    const size_t num_channels = channels.size();
+    // ClassifyValues doesn't install completed async rebuilds, so do it once up front
+    for (auto &channel : channels) {
+        channel.widget->PollRebuild();
+    }
+    for (size_t begin = 0; begin < count; begin += classify_block_size) {
+        const size_t n = std::min(classify_block_size, count - begin);
+        const float *block = voxels + begin * num_channels;
+        uint8_t *out = rgba + begin * num_channels * 4;
+        for (size_t c = 0; c < num_channels; ++c) {
+            const ImVec2 data_range(channels[c].data_min, channels[c].data_max);
+            channels[c].widget->ClassifyValues(block + c,
+                                               n,
+                                               data_range,
+                                               out + c * 4,
+                                               num_channels,
+                                               num_channels * 4);
+        }
+    }
+}
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "gl_texture.h"
+#include "transfer_function_widget.h"
+
+namespace ImTF {
+
+// Manages one transfer function widget per channel of a multivariate volume and
+// packs all their tables into a single texture, one row per channel, so the
+// renderer binds one texture and changed channels are uploaded in one call
+class MultiChannelTransferFunction {
+public:
+    enum Packing {
+        // A GL_TEXTURE_2D_ARRAY with one width x 1 layer per channel
+        PACK_TEXTURE_ARRAY,
+        // A width x channels GL_TEXTURE_2D atlas
+        PACK_ATLAS_2D
+    };
+
+private:
+    struct Channel {
+        std::string name;
+        std::unique_ptr<TransferFunctionWidget> widget;
+        // Data range mapped across the channel's transfer function, as for DrawRuler
+        float data_min = 0.f;
+        float data_max = 1.f;
+        // Colormap version currently packed, or -1 if it hasn't been packed yet
+        uint64_t packed_version = -1;
+    };
+
+    std::vector<Channel> channels;
+    int width;
+    Packing packing;
+    bool noGui;
+    size_t selected_channel = 0;
+
+    // The packed RGBA8 tables, channel i is row i
+    std::vector<uint8_t> packed;
+    // Rows changed since the last GPU upload, [gpu_dirty_begin, gpu_dirty_end)
+    size_t gpu_dirty_begin = 0;
+    size_t gpu_dirty_end = 0;
+    GLTexture texture;
+    // Number of layers the texture was allocated with
+    size_t texture_layers = 0;
+
+public:
+    // Tables are resampled to width texels when packed
+    MultiChannelTransferFunction(int width = 256,
+                                 Packing packing = PACK_TEXTURE_ARRAY,
+                                 bool noGui = false);
+
+    // Add a channel, returns its index
+    size_t AddChannel(const std::string &name, float data_min = 0.f, float data_max = 1.f);
+
+    size_t NumChannels() const;
+
+    // The widget editing the channel's transfer function
+    TransferFunctionWidget &GetChannel(size_t i);
+
+    void SetDataRange(size_t i, float data_min, float data_max);
+
+    // Draws a channel selector and the selected channel's transfer function editor
+    void DrawColorMap(bool show_help = true);
+
+    // Repack the tables of channels which changed since the last call, returns true
+    // if any did
+    bool Update();
+
+    // Update the packed tables and upload the changed rows to the texture in a single
+    // call. The texture target is GL_TEXTURE_2D_ARRAY or GL_TEXTURE_2D depending on
+    // the packing
+    void UpdateGPUImage();
+
+    GLuint GetTexture() const;
+
+    // The packed RGBA8 tables, channel i is row i of width texels
+    const std::vector<uint8_t> &GetPackedColormaps() const;
+
+    int Width() const;
+
+    // Classify count interleaved voxels of NumChannels() values each, writing RGBA8
+    // colors for every channel of every voxel: rgba[(voxel * channels + channel) * 4].
+    // All channels of a block of voxels are classified in one pass over the data
+    void Classify(const float *voxels, size_t count, uint8_t *rgba);
+};
+}
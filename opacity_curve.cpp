@@ -0,0 +1,180 @@
+#include "opacity_curve.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "table_lookup.h"
+
+namespace ImTF {
+
+const char *InterpolationModeName(InterpolationMode mode)
+{
+    switch (mode) {
+    case INTERP_LINEAR:
+        return "Linear";
+    case INTERP_SMOOTHSTEP:
+        return "Smoothstep";
+    case INTERP_MONOTONE_CUBIC:
+        return "Monotone Cubic";
+    case INTERP_STEP:
+        return "Step";
+    default:
+        return "Unknown";
+    }
+}
+
+size_t CurveSegments::Size() const
+{
+    return x0.size();
+}
+
+void ComputeCurveSegments(const float *x,
+                          const float *y,
+                          const InterpolationMode *modes,
+                          size_t n,
+                          CurveSegments &segments)
+{
+    const size_t num_segments = n > 1 ? n - 1 : 0;
+    segments.x0.resize(num_segments);
+    segments.inv_width.resize(num_segments);
+    segments.c0.resize(num_segments);
+    segments.c1.resize(num_segments);
+    segments.c2.resize(num_segments);
+    segments.c3.resize(num_segments);
+    if (num_segments == 0) {
+        return;
+    }
+
+    // Secant slopes of the segments, and the Fritsch-Carlson tangents at the points
+    std::vector<float> secant(num_segments);
+    for (size_t i = 0; i < num_segments; ++i) {
+        const float h = x[i + 1] - x[i];
+        secant[i] = h > 0.f ? (y[i + 1] - y[i]) / h : 0.f;
+    }
+    std::vector<float> tangent(n);
+    tangent[0] = secant[0];
+    tangent[n - 1] = secant[num_segments - 1];
+    for (size_t i = 1; i + 1 < n; ++i) {
+        // Flat at local extrema, which keeps the curve monotone between points
+        tangent[i] = secant[i - 1] * secant[i] <= 0.f ? 0.f : (secant[i - 1] + secant[i]) * 0.5f;
+    }
+    for (size_t i = 0; i < num_segments; ++i) {
+        if (secant[i] == 0.f) {
+            tangent[i] = 0.f;
+            tangent[i + 1] = 0.f;
+            continue;
+        }
+        const float a = tangent[i] / secant[i];
+        const float b = tangent[i + 1] / secant[i];
+        const float len = a * a + b * b;
+        if (len > 9.f) {
+            const float tau = 3.f / std::sqrt(len);
+            tangent[i] = tau * a * secant[i];
+            tangent[i + 1] = tau * b * secant[i];
+        }
+    }
+
+    for (size_t i = 0; i < num_segments; ++i) {
+        const float h = x[i + 1] - x[i];
+        const float d = y[i + 1] - y[i];
+        segments.x0[i] = x[i];
+        segments.inv_width[i] = h > 0.f ? 1.f / h : 0.f;
+        segments.c0[i] = y[i];
+        switch (modes[i]) {
+        case INTERP_SMOOTHSTEP:
+            segments.c1[i] = 0.f;
+            segments.c2[i] = 3.f * d;
+            segments.c3[i] = -2.f * d;
+            break;
+        case INTERP_MONOTONE_CUBIC: {
+            const float m0 = tangent[i] * h;
+            const float m1 = tangent[i + 1] * h;
+            segments.c1[i] = m0;
+            segments.c2[i] = 3.f * d - 2.f * m0 - m1;
+            segments.c3[i] = -2.f * d + m0 + m1;
+            break;
+        }
+        case INTERP_STEP:
+            segments.c1[i] = 0.f;
+            segments.c2[i] = 0.f;
+            segments.c3[i] = 0.f;
+            break;
+        default:
+            segments.c1[i] = d;
+            segments.c2[i] = 0.f;
+            segments.c3[i] = 0.f;
+            break;
+        }
+    }
+}
+
+float EvaluateCurve(const CurveSegments &segments, float x)
+{
+    const size_t num_segments = segments.Size();
+    if (num_segments == 0) {
+        return 0.f;
+    }
+    // Same segment choice as SampleCurve, a position on a control point belongs to the
+    // segment ending there
+    const float *x0 = segments.x0.data();
+    const size_t s = std::lower_bound(x0 + 1, x0 + num_segments, x) - (x0 + 1);
+    float t = (x - x0[s]) * segments.inv_width[s];
+    t = t > 0.f ? t : 0.f;
+    t = t < 1.f ? t : 1.f;
+    return segments.c0[s] + t * (segments.c1[s] + t * (segments.c2[s] + t * segments.c3[s]));
+}
+
+void SampleCurve(const CurveSegments &segments,
+                 size_t count,
+                 float *out,
+                 size_t begin,
+                 size_t end)
+{
+    end = std::min(end, count);
+    if (begin >= end) {
+        return;
+    }
+    const size_t num_segments = segments.Size();
+    if (num_segments == 0) {
+        std::fill(out, out + (end - begin), 0.f);
+        return;
+    }
+    const float *x0 = segments.x0.data();
+    const float *inv_width = segments.inv_width.data();
+    const float *c0 = segments.c0.data();
+    const float *c1 = segments.c1.data();
+    const float *c2 = segments.c2.data();
+    const float *c3 = segments.c3.data();
+
+    int32_t index[classify_block_size];
+    float xs[classify_block_size];
+    float values[classify_block_size];
+    // Start from the segment ending at or after the first position
+    const float first_x = static_cast<float>(begin) / count;
+    size_t seg = std::lower_bound(x0 + 1, x0 + num_segments, first_x) - (x0 + 1);
+    for (size_t block = begin; block < end; block += classify_block_size) {
+        const size_t n = std::min(classify_block_size, end - block);
+        // The positions increase, so find their segments walking forward. A position on
+        // a control point belongs to the segment ending there
+        for (size_t i = 0; i < n; ++i) {
+            const float x = static_cast<float>(block + i) / count;
+            while (seg + 1 < num_segments && x > x0[seg + 1]) {
+                ++seg;
+            }
+            xs[i] = x;
+            index[i] = static_cast<int32_t>(seg);
+        }
+        // Evaluate the cubics without branching on the mode. The results go to a local
+        // block first, as the coefficient gathers only vectorize when the output
+        // can't alias the coefficients
+        for (size_t i = 0; i < n; ++i) {
+            const int32_t s = index[i];
+            float t = (xs[i] - x0[s]) * inv_width[s];
+            t = t > 0.f ? t : 0.f;
+            t = t < 1.f ? t : 1.f;
+            values[i] = c0[s] + t * (c1[s] + t * (c2[s] + t * c3[s]));
+        }
+        std::memcpy(out + (block - begin), values, n * sizeof(float));
+    }
+}
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ImTF {
+
+// How the opacity curve is interpolated from a control point to the next one
+enum InterpolationMode {
+    INTERP_LINEAR,
+    // Ease in and out of the control points with zero slope at both ends
+    INTERP_SMOOTHSTEP,
+    // Cubic Hermite through the neighboring points with Fritsch-Carlson tangents, smooth
+    // without overshooting so the opacity stays between the control points
+    INTERP_MONOTONE_CUBIC,
+    // Hold the control point's value until the next one
+    INTERP_STEP,
+    NUM_INTERPOLATION_MODES
+};
+
+const char *InterpolationModeName(InterpolationMode mode);
+
+// The segments of a curve, each mode is expressed as a cubic in the local parameter
+// t = (x - x0) * inv_width in [0, 1], stored as separate arrays so sampling can gather
+// the coefficients with simple loops the compiler vectorizes
+struct CurveSegments {
+    std::vector<float> x0;
+    std::vector<float> inv_width;
+    std::vector<float> c0, c1, c2, c3;
+
+    size_t Size() const;
+};
+
+// Compute the segments of the curve through the n points (x[i], y[i]), sorted by x.
+// The segment from point i to i + 1 is interpolated with modes[i]
+void ComputeCurveSegments(const float *x,
+                          const float *y,
+                          const InterpolationMode *modes,
+                          size_t n,
+                          CurveSegments &segments);
+
+// Evaluate the curve at a single position
+float EvaluateCurve(const CurveSegments &segments, float x);
+
+// Sample the curve at the positions i / count, for i in [begin, end) (clamped to
+// count), writing the sample at i to out[i - begin]
+void SampleCurve(const CurveSegments &segments,
+                 size_t count,
+                 float *out,
+                 size_t begin = 0,
+                 size_t end = size_t(-1));
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+namespace ImTF {
+
+// The number of calls to an operation and the time spent in them
+struct TimingCounter {
+    uint64_t calls = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+
+    void Add(uint64_t ns)
+    {
+        ++calls;
+        total_ns += ns;
+        max_ns = std::max(max_ns, ns);
+    }
+
+    double MeanMicroseconds() const
+    {
+        return calls ? total_ns / (1000.0 * calls) : 0.0;
+    }
+};
+
+// Counters of the work done by a widget, to diagnose slow UIs from the outside
+struct PerformanceCounters {
+    // Tables rebuilt from scratch, and opacity updates of only the changed segments
+    uint64_t table_rebuilds = 0;
+    uint64_t partial_table_updates = 0;
+    // Table entries recomputed by the rebuilds and updates
+    uint64_t texels_recomputed = 0;
+    // Uploads of the 1D and 2D tables to their textures, and the bytes uploaded
+    uint64_t gpu_uploads = 0;
+    uint64_t gpu_upload_bytes = 0;
+    uint64_t snapshots_published = 0;
+    // Heap allocations made by the widget while updating and drawing, and their size
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+
+    TimingCounter update_colormap;
+    TimingCounter update_gpu_image;
+    TimingCounter draw_colormap;
+};
+
+// Adds the time from its construction to its destruction to a counter
+class ScopedTimer {
+    TimingCounter &counter;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit ScopedTimer(TimingCounter &counter)
+        : counter(counter), start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    ~ScopedTimer()
+    {
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        counter.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+};
+
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace ImTF {
+
+// How overlays are written into an image
+enum OverlayMode {
+    // Replace the image pixels, antialiased edges are still blended by coverage
+    OVERLAY_OVERWRITE,
+    // Blend over the image pixels using the colormap's opacity
+    OVERLAY_ALPHA_BLEND
+};
+
+// Conversion of 8-bit unorm values to a channel type. Integer channels are
+// unorm values of their full range, float channels are in [0, 1]
+template <typename T>
+struct ChannelTraits;
+
+template <>
+struct ChannelTraits<uint8_t> {
+    static uint8_t FromUnorm8(uint32_t v)
+    {
+        return static_cast<uint8_t>(v);
+    }
+
+    static uint8_t Lerp(uint8_t a, uint8_t b, float t)
+    {
+        return static_cast<uint8_t>(a + (static_cast<float>(b) - a) * t + 0.5f);
+    }
+};
+
+template <>
+struct ChannelTraits<uint16_t> {
+    static uint16_t FromUnorm8(uint32_t v)
+    {
+        return static_cast<uint16_t>(v * 257);
+    }
+
+    static uint16_t Lerp(uint16_t a, uint16_t b, float t)
+    {
+        return static_cast<uint16_t>(a + (static_cast<float>(b) - a) * t + 0.5f);
+    }
+};
+
+template <>
+struct ChannelTraits<float> {
+    static float FromUnorm8(uint32_t v)
+    {
+        return v / 255.f;
+    }
+
+    static float Lerp(float a, float b, float t)
+    {
+        return a + (b - a) * t;
+    }
+};
+
+// Describes the memory layout of an interleaved pixel: its channel type, number of
+// channels and the position of red, green, blue and alpha within a pixel (alpha is
+// -1 if the format has none). Overlays are written through the format's row functions,
+// which convert from the packed RGBA8 values used internally (0xAABBGGRR)
+template <typename T, int Channels, int R, int G, int B, int A>
+struct PixelFormat {
+    using channel_type = T;
+    using traits = ChannelTraits<T>;
+
+    static const int channels = Channels;
+    static const size_t pixel_size = sizeof(T) * Channels;
+
+    // Formats matching the in-memory layout of the packed RGBA8 values
+    // on little-endian machines can be written with a plain copy
+    static const bool packed_rgba8 =
+        std::is_same<T, uint8_t>::value && Channels == 4 && R == 0 && G == 1 && B == 2 && A == 3;
+
+    // Write n packed RGBA8 pixels to dst
+    static void StoreRow(T *dst, const uint32_t *src, int n)
+    {
+        if (packed_rgba8) {
+            std::memcpy(dst, src, n * sizeof(uint32_t));
+            return;
+        }
+        for (int i = 0; i < n; ++i) {
+            const uint32_t p = src[i];
+            T *px = dst + i * Channels;
+            px[R] = traits::FromUnorm8(p & 0xFF);
+            px[G] = traits::FromUnorm8((p >> 8) & 0xFF);
+            px[B] = traits::FromUnorm8((p >> 16) & 0xFF);
+            StoreAlpha(px, traits::FromUnorm8(p >> 24), std::integral_constant<bool, (A >= 0)>());
+        }
+    }
+
+    // Blend n packed RGBA8 pixels into dst weighted by their coverage. When alpha
+    // blending the weight is also scaled by the pixel's alpha and the destination
+    // alpha is composited "over", otherwise it is blended towards the source alpha
+    static void BlendRow(T *dst, const uint32_t *src, const uint8_t *coverage, int n, bool alpha_blend)
+    {
+        const T opaque = traits::FromUnorm8(255);
+        for (int i = 0; i < n; ++i) {
+            const uint32_t p = src[i];
+            const uint32_t alpha = p >> 24;
+            const float w = alpha_blend ? coverage[i] * alpha / (255.f * 255.f) : coverage[i] / 255.f;
+            T *px = dst + i * Channels;
+            px[R] = traits::Lerp(px[R], traits::FromUnorm8(p & 0xFF), w);
+            px[G] = traits::Lerp(px[G], traits::FromUnorm8((p >> 8) & 0xFF), w);
+            px[B] = traits::Lerp(px[B], traits::FromUnorm8((p >> 16) & 0xFF), w);
+            BlendAlpha(px,
+                       alpha_blend ? opaque : traits::FromUnorm8(alpha),
+                       w,
+                       std::integral_constant<bool, (A >= 0)>());
+        }
+    }
+
+private:
+    static void StoreAlpha(T *px, T a, std::true_type)
+    {
+        px[A] = a;
+    }
+
+    static void StoreAlpha(T *, T, std::false_type) {}
+
+    static void BlendAlpha(T *px, T a, float w, std::true_type)
+    {
+        px[A] = traits::Lerp(px[A], a, w);
+    }
+
+    static void BlendAlpha(T *, T, float, std::false_type) {}
+};
+
+using RGBA8Format = PixelFormat<uint8_t, 4, 0, 1, 2, 3>;
+using BGRA8Format = PixelFormat<uint8_t, 4, 2, 1, 0, 3>;
+using RGB8Format = PixelFormat<uint8_t, 3, 0, 1, 2, -1>;
+using RGBA16Format = PixelFormat<uint16_t, 4, 0, 1, 2, 3>;
+using RGBA32FFormat = PixelFormat<float, 4, 0, 1, 2, 3>;
+
+}
@@ -0,0 +1,192 @@
+#include "quantile_sketch.h"
+#include <cmath>
+#include <limits>
+
+namespace ImTF {
+
+QuantileSketch::QuantileSketch(uint32_t k, uint64_t seed)
+    : k(std::max(k, 8u)),
+      min(std::numeric_limits<float>::max()),
+      max(std::numeric_limits<float>::lowest()),
+      rng_state(seed ? seed : 1),
+      levels(1)
+{
+    UpdateCapacity();
+}
+
+void QuantileSketch::Add(float v)
+{
+    if (v != v) {
+        return;
+    }
+    min = v < min ? v : min;
+    max = v > max ? v : max;
+    ++count;
+    levels[0].push_back(v);
+    ++retained;
+    if (retained >= capacity) {
+        Compress();
+    }
+}
+
+void QuantileSketch::Merge(const QuantileSketch &b)
+{
+    if (b.count == 0) {
+        return;
+    }
+    if (levels.size() < b.levels.size()) {
+        levels.resize(b.levels.size());
+    }
+    for (size_t h = 0; h < b.levels.size(); ++h) {
+        levels[h].insert(levels[h].end(), b.levels[h].begin(), b.levels[h].end());
+    }
+    count += b.count;
+    min = std::min(min, b.min);
+    max = std::max(max, b.max);
+    retained += b.retained;
+    UpdateCapacity();
+    Compress();
+}
+
+bool QuantileSketch::Empty() const
+{
+    return count == 0;
+}
+
+uint64_t QuantileSketch::Count() const
+{
+    return count;
+}
+
+float QuantileSketch::Min() const
+{
+    return count ? min : 0.f;
+}
+
+float QuantileSketch::Max() const
+{
+    return count ? max : 0.f;
+}
+
+float QuantileSketch::Quantile(double q) const
+{
+    if (count == 0) {
+        return 0.f;
+    }
+    if (q <= 0.0) {
+        return min;
+    }
+    if (q >= 1.0) {
+        return max;
+    }
+    const auto values = SortedValues();
+    uint64_t total = 0;
+    for (const auto &v : values) {
+        total += v.second;
+    }
+    const double target = q * total;
+    uint64_t cumulative = 0;
+    for (const auto &v : values) {
+        cumulative += v.second;
+        if (cumulative >= target) {
+            return std::min(std::max(v.first, min), max);
+        }
+    }
+    return max;
+}
+
+double QuantileSketch::Rank(float v) const
+{
+    if (count == 0) {
+        return 0.0;
+    }
+    uint64_t below = 0;
+    uint64_t total = 0;
+    for (size_t h = 0; h < levels.size(); ++h) {
+        for (const auto &x : levels[h]) {
+            total += uint64_t(1) << h;
+            if (x <= v) {
+                below += uint64_t(1) << h;
+            }
+        }
+    }
+    return static_cast<double>(below) / total;
+}
+
+size_t QuantileSketch::NumRetained() const
+{
+    return retained;
+}
+
+size_t QuantileSketch::LevelCapacity(size_t level) const
+{
+    // Capacities shrink geometrically by 2/3 going down from the top level
+    const size_t depth = levels.size() - 1 - level;
+    const double c = std::ceil(k * std::pow(2.0 / 3.0, static_cast<double>(depth)));
+    return std::max(static_cast<size_t>(c), size_t(2));
+}
+
+void QuantileSketch::UpdateCapacity()
+{
+    capacity = 0;
+    for (size_t h = 0; h < levels.size(); ++h) {
+        capacity += LevelCapacity(h);
+    }
+}
+
+void QuantileSketch::Compress()
+{
+    while (retained >= capacity) {
+        // Compact the lowest level that's full, one always is when over capacity
+        size_t h = 0;
+        while (h < levels.size() && levels[h].size() < LevelCapacity(h)) {
+            ++h;
+        }
+        if (h == levels.size()) {
+            break;
+        }
+        if (h + 1 == levels.size()) {
+            levels.emplace_back();
+            UpdateCapacity();
+        }
+
+        std::vector<float> &level = levels[h];
+        std::vector<float> &next = levels[h + 1];
+        std::sort(level.begin(), level.end());
+        // With an odd number of values the largest stays behind
+        const size_t pairs = level.size() / 2;
+        // Promote the even or odd values at random, xorshift64
+        rng_state ^= rng_state << 13;
+        rng_state ^= rng_state >> 7;
+        rng_state ^= rng_state << 17;
+        const size_t offset = rng_state & 1;
+        for (size_t i = 0; i < pairs; ++i) {
+            next.push_back(level[2 * i + offset]);
+        }
+        if (level.size() % 2) {
+            level[0] = level.back();
+            level.resize(1);
+        } else {
+            level.clear();
+        }
+        retained -= pairs;
+    }
+}
+
+std::vector<std::pair<float, uint64_t>> QuantileSketch::SortedValues() const
+{
+    std::vector<std::pair<float, uint64_t>> values;
+    values.reserve(retained);
+    for (size_t h = 0; h < levels.size(); ++h) {
+        for (const auto &x : levels[h]) {
+            values.emplace_back(x, uint64_t(1) << h);
+        }
+    }
+    std::sort(values.begin(), values.end(),
+              [](const std::pair<float, uint64_t> &a, const std::pair<float, uint64_t> &b) {
+                  return a.first < b.first;
+              });
+    return values;
+}
+
+}
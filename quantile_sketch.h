@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <vector>
+#include "thread_pool.h"
+
+namespace ImTF {
+
+// A mergeable approximate quantile sketch (KLL) of a stream of values, using memory
+// logarithmic in the number of values added. Values are kept in levels of compactors,
+// where each value at level h stands for 2^h of the input. When a level fills up it's
+// sorted and every other value is promoted to the next level. Quantiles have a rank
+// error of roughly 1.7 / k, sketches built separately (over chunks of data, timesteps
+// or files) can be merged with the same guarantee
+class QuantileSketch {
+    uint32_t k;
+    uint64_t count = 0;
+    float min;
+    float max;
+    uint64_t rng_state;
+    std::vector<std::vector<float>> levels;
+    size_t retained = 0;
+    size_t capacity = 0;
+
+public:
+    explicit QuantileSketch(uint32_t k = 200, uint64_t seed = 1);
+
+    // Add a value to the sketch, NaNs are ignored
+    void Add(float v);
+
+    // Add count values read with the given stride (in elements)
+    template <typename T>
+    void AddData(const T *data, size_t count, size_t stride = 1);
+
+    // Merge the values summarized by another sketch into this one
+    void Merge(const QuantileSketch &b);
+
+    bool Empty() const;
+
+    // The number of values added
+    uint64_t Count() const;
+
+    // The exact min and max of the values added
+    float Min() const;
+    float Max() const;
+
+    // The approximate value at quantile q in [0, 1], 0 and 1 give the min and max
+    float Quantile(double q) const;
+
+    // The approximate fraction of values less than or equal to v
+    double Rank(float v) const;
+
+    // The number of values stored by the sketch
+    size_t NumRetained() const;
+
+private:
+    size_t LevelCapacity(size_t level) const;
+
+    void UpdateCapacity();
+
+    // Compact levels until the retained values fit in the capacity
+    void Compress();
+
+    // The values retained with their weights, sorted by value
+    std::vector<std::pair<float, uint64_t>> SortedValues() const;
+};
+
+template <typename T>
+void QuantileSketch::AddData(const T *data, size_t n, size_t stride)
+{
+    for (size_t i = 0; i < n; ++i) {
+        Add(static_cast<float>(data[i * stride]));
+    }
+}
+
+// Build a quantile sketch of count values read with the given stride (in elements).
+// The data is split into chunks sketched in parallel on num_threads threads (0 for
+// one per hardware thread), which are merged in order so the result is deterministic
+template <typename T>
+QuantileSketch ComputeQuantileSketch(const T *data,
+                                     size_t count,
+                                     size_t stride = 1,
+                                     uint32_t k = 200,
+                                     unsigned num_threads = 0)
+{
+    QuantileSketch sketch(k);
+    if (count == 0) {
+        return sketch;
+    }
+
+    ThreadPool pool(num_threads);
+    const size_t num_chunks = std::min(count, pool.Size() * 4);
+    const size_t chunk_size = (count + num_chunks - 1) / num_chunks;
+    std::vector<QuantileSketch> chunk_sketches;
+    for (size_t c = 0; c < num_chunks; ++c) {
+        chunk_sketches.emplace_back(k, c + 1);
+    }
+    std::vector<std::future<void>> done;
+    for (size_t c = 0; c < num_chunks; ++c) {
+        const size_t begin = c * chunk_size;
+        const size_t end = std::min(count, begin + chunk_size);
+        if (begin < end) {
+            QuantileSketch *s = &chunk_sketches[c];
+            done.push_back(pool.Submit([s, data, begin, end, stride]() {
+                s->AddData(data + begin * stride, end - begin, stride);
+            }));
+        }
+    }
+    for (auto &d : done) {
+        d.get();
+    }
+    for (const auto &s : chunk_sketches) {
+        sketch.Merge(s);
+    }
+    return sketch;
+}
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ImTF {
+
+// Publishes immutable snapshots of a value from one writer thread to any number of
+// reader threads. Readers acquire the latest snapshot wait-free: a few atomic operations
+// with no locks or retry loops, and they can hold it as long as they need. Replaced
+// snapshots are retired and reclaimed by the writer once no reader holds them, and no
+// reader can still be acquiring them (a grace period where no reader was acquiring a
+// snapshot was seen after the snapshot was replaced)
+template <typename T>
+class SnapshotPublisher {
+    struct Node {
+        T value;
+        std::atomic<uint32_t> refs;
+        bool grace_passed = false;
+
+        explicit Node(T v) : value(std::move(v)), refs(0) {}
+    };
+
+    std::atomic<Node *> current;
+    // The number of readers between loading the current snapshot and referencing it
+    mutable std::atomic<uint32_t> acquiring;
+    // Replaced snapshots which may still be held by readers, only used by the writer
+    std::vector<Node *> retired;
+
+public:
+    // A reference to a snapshot which keeps it alive until the handle is destroyed
+    class Handle {
+        const Node *node = nullptr;
+
+        friend class SnapshotPublisher;
+
+        explicit Handle(const Node *node) : node(node) {}
+
+    public:
+        Handle() = default;
+        Handle(const Handle &) = delete;
+        Handle &operator=(const Handle &) = delete;
+
+        Handle(Handle &&h) : node(h.node)
+        {
+            h.node = nullptr;
+        }
+
+        Handle &operator=(Handle &&h)
+        {
+            if (this != &h) {
+                Release();
+                node = h.node;
+                h.node = nullptr;
+            }
+            return *this;
+        }
+
+        ~Handle()
+        {
+            Release();
+        }
+
+        explicit operator bool() const
+        {
+            return node != nullptr;
+        }
+
+        const T &operator*() const
+        {
+            return node->value;
+        }
+
+        const T *operator->() const
+        {
+            return &node->value;
+        }
+
+        void Release()
+        {
+            if (node) {
+                const_cast<Node *>(node)->refs.fetch_sub(1, std::memory_order_acq_rel);
+                node = nullptr;
+            }
+        }
+    };
+
+    SnapshotPublisher() : current(nullptr), acquiring(0) {}
+
+    SnapshotPublisher(const SnapshotPublisher &) = delete;
+    SnapshotPublisher &operator=(const SnapshotPublisher &) = delete;
+
+    // Moving isn't thread-safe, there must be no readers or writer using either publisher
+    SnapshotPublisher(SnapshotPublisher &&p)
+        : current(p.current.exchange(nullptr)), acquiring(0), retired(std::move(p.retired))
+    {
+        p.retired.clear();
+    }
+
+    SnapshotPublisher &operator=(SnapshotPublisher &&p)
+    {
+        if (this != &p) {
+            Destroy();
+            current.store(p.current.exchange(nullptr));
+            retired = std::move(p.retired);
+            p.retired.clear();
+        }
+        return *this;
+    }
+
+    // All handles must have been released
+    ~SnapshotPublisher()
+    {
+        Destroy();
+    }
+
+    // Replace the current snapshot, only called by the writer thread. Retired snapshots
+    // no longer in use are reclaimed
+    void Publish(T value)
+    {
+        Node *old = current.exchange(new Node(std::move(value)));
+        if (old) {
+            retired.push_back(old);
+        }
+        Reclaim();
+    }
+
+    // Get the latest snapshot, an empty handle if nothing was published yet. Can be
+    // called from any thread
+    Handle Acquire() const
+    {
+        acquiring.fetch_add(1);
+        Node *node = current.load();
+        if (node) {
+            node->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        acquiring.fetch_sub(1);
+        return Handle(node);
+    }
+
+    // Reclaim the retired snapshots no longer in use, only called by the writer thread
+    void Reclaim()
+    {
+        if (retired.empty()) {
+            return;
+        }
+        // Readers acquiring after this point see a newer snapshot, so once none are
+        // acquiring the retired ones can only be referenced by existing handles
+        if (acquiring.load() == 0) {
+            for (auto &n : retired) {
+                n->grace_passed = true;
+            }
+        }
+        auto end = retired.begin();
+        for (auto &n : retired) {
+            if (n->grace_passed && n->refs.load(std::memory_order_acquire) == 0) {
+                delete n;
+            } else {
+                *end++ = n;
+            }
+        }
+        retired.erase(end, retired.end());
+    }
+
+    // The number of retired snapshots still waiting to be reclaimed
+    size_t NumRetired() const
+    {
+        return retired.size();
+    }
+
+private:
+    void Destroy()
+    {
+        delete current.exchange(nullptr);
+        for (auto &n : retired) {
+            delete n;
+        }
+        retired.clear();
+    }
+};
+
+}
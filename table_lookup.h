@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace ImTF {
+
+// Values are classified in blocks so each step is a simple loop over a small
+// array the compiler can vectorize
+const size_t classify_block_size = 256;
+
+// Map values to table indices floor((value - offset) * scale) clamped to [0, max_index].
+// NaNs map to 0
+inline void ComputeTableIndices(const float *values,
+                                size_t count,
+                                size_t stride,
+                                float offset,
+                                float scale,
+                                int32_t max_index,
+                                int32_t *indices)
+{
+    const float max_f = static_cast<float>(max_index);
+    for (size_t i = 0; i < count; ++i) {
+        float f = (values[i * stride] - offset) * scale;
+        f = f > 0.f ? f : 0.f;
+        f = f < max_f ? f : max_f;
+        indices[i] = static_cast<int32_t>(f);
+    }
+}
+
+// Copy the RGBA8 texels at the indices to the output, writing each one rgba_stride
+// bytes after the previous one
+inline void GatherRGBA8(const uint8_t *table,
+                        const int32_t *indices,
+                        size_t count,
+                        uint8_t *rgba,
+                        size_t rgba_stride = 4)
+{
+    for (size_t i = 0; i < count; ++i) {
+        std::memcpy(rgba + i * rgba_stride, table + static_cast<size_t>(indices[i]) * 4, 4);
+    }
+}
+}
@@ -0,0 +1,63 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+namespace ImTF {
+
+ThreadPool::ThreadPool(unsigned num_threads)
+{
+    if (num_threads == 0) {
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    workers.reserve(num_threads);
+    for (unsigned i = 0; i < num_threads; ++i) {
+        workers.emplace_back([this]() { Worker(); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    task_available.notify_all();
+    for (auto &w : workers) {
+        w.join();
+    }
+}
+
+size_t ThreadPool::Size() const
+{
+    return workers.size();
+}
+
+std::future<void> ThreadPool::Submit(std::function<void()> task)
+{
+    std::packaged_task<void()> packaged(std::move(task));
+    std::future<void> result = packaged.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(packaged));
+    }
+    task_available.notify_one();
+    return result;
+}
+
+void ThreadPool::Worker()
+{
+    while (true) {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            task_available.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ImTF {
+
+// A fixed set of worker threads running tasks in submission order, used by the
+// widget's batch and background operations
+class ThreadPool {
+    std::vector<std::thread> workers;
+    std::deque<std::packaged_task<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable task_available;
+    bool stopping = false;
+
+public:
+    // Start num_threads workers, or one per hardware thread if 0
+    explicit ThreadPool(unsigned num_threads = 0);
+
+    // Finishes the queued tasks and joins the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t Size() const;
+
+    // Queue a task, the future becomes ready once it has run and rethrows
+    // any exception it threw
+    std::future<void> Submit(std::function<void()> task);
+
+private:
+    void Worker();
+};
+}
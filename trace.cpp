@@ -0,0 +1,187 @@
+#include "trace.h"
+
+#ifdef TFN_ENABLE_TRACING
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+namespace ImTF {
+
+namespace {
+
+struct TraceEvent {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+};
+
+// The zones recorded by one thread. Only the owning thread writes events, and publishes
+// them by storing size, so readers only read the events below the size they loaded.
+// Events are stored in blocks allocated as the buffer fills, so threads recording few
+// zones only take one block
+struct ThreadBuffer {
+    static const size_t block_size = 1 << 10;
+    static const size_t num_blocks = 32;
+    static const size_t capacity = block_size * num_blocks;
+
+    // Allocated before size is stored past their start, so readers see them
+    std::atomic<TraceEvent *> blocks[num_blocks];
+    std::atomic<size_t> size;
+    std::atomic<uint64_t> dropped;
+    // Cleared when the owning thread exits, for a new thread to take over the buffer
+    std::atomic<bool> in_use;
+    uint32_t thread_id;
+    ThreadBuffer *next;
+
+    explicit ThreadBuffer(uint32_t thread_id)
+        : size(0), dropped(0), in_use(true), thread_id(thread_id), next(nullptr)
+    {
+        for (auto &b : blocks) {
+            b.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    TraceEvent &Event(size_t i) const
+    {
+        return blocks[i / block_size].load(std::memory_order_relaxed)[i % block_size];
+    }
+};
+
+// The buffers of every thread which has recorded a zone. Buffers are never freed, the
+// buffer of an exited thread keeps its zones and is reused by the next thread which
+// records one, so threads which come and go (e.g. short-lived pools) don't add buffers
+std::atomic<ThreadBuffer *> buffers(nullptr);
+std::atomic<uint32_t> next_thread_id(1);
+
+const uint64_t trace_start = trace::Now();
+
+// Releases the thread's buffer for reuse when the thread exits
+struct BufferOwner {
+    ThreadBuffer *buffer = nullptr;
+
+    ~BufferOwner()
+    {
+        if (buffer) {
+            buffer->in_use.store(false, std::memory_order_release);
+        }
+    }
+};
+
+ThreadBuffer *thread_buffer()
+{
+    thread_local BufferOwner owner;
+    if (owner.buffer) {
+        return owner.buffer;
+    }
+    for (ThreadBuffer *b = buffers.load(); b; b = b->next) {
+        bool in_use = false;
+        if (b->in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire)) {
+            owner.buffer = b;
+            return b;
+        }
+    }
+    ThreadBuffer *buffer = new ThreadBuffer(next_thread_id++);
+    ThreadBuffer *head = buffers.load();
+    do {
+        buffer->next = head;
+    } while (!buffers.compare_exchange_weak(head, buffer));
+    owner.buffer = buffer;
+    return buffer;
+}
+
+void write_json_string(std::ostream &out, const char *s)
+{
+    out << '"';
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') {
+            out << '\\';
+        }
+        out << *s;
+    }
+    out << '"';
+}
+
+}
+
+namespace trace {
+
+uint64_t Now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void RecordZone(const char *name, uint64_t start, uint64_t end)
+{
+    ThreadBuffer *buffer = thread_buffer();
+    const size_t i = buffer->size.load(std::memory_order_relaxed);
+    if (i >= ThreadBuffer::capacity) {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    std::atomic<TraceEvent *> &block = buffer->blocks[i / ThreadBuffer::block_size];
+    if (!block.load(std::memory_order_relaxed)) {
+        block.store(new TraceEvent[ThreadBuffer::block_size], std::memory_order_relaxed);
+    }
+    buffer->Event(i) = {name, start, end};
+    buffer->size.store(i + 1, std::memory_order_release);
+}
+
+}
+
+bool WriteChromeTrace(const std::string &filepath)
+{
+    std::ofstream out(filepath);
+    if (!out) {
+        std::cerr << "Failed to open " << filepath << " for writing\n";
+        return false;
+    }
+    out << std::fixed;
+    out.precision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    uint64_t dropped = 0;
+    for (ThreadBuffer *b = buffers.load(); b; b = b->next) {
+        out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+            << "\"tid\": " << b->thread_id << ", \"args\": {\"name\": \"thread "
+            << b->thread_id << "\"}}";
+        first = false;
+
+        const size_t size = b->size.load(std::memory_order_acquire);
+        for (size_t i = 0; i < size; ++i) {
+            const TraceEvent &e = b->Event(i);
+            out << ",\n{\"name\": ";
+            write_json_string(out, e.name);
+            // Chrome trace timestamps are in microseconds
+            out << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << b->thread_id
+                << ", \"ts\": " << (e.start - trace_start) / 1000.0
+                << ", \"dur\": " << (e.end - e.start) / 1000.0 << "}";
+        }
+        dropped += b->dropped.load(std::memory_order_relaxed);
+    }
+    out << "\n]}\n";
+    if (dropped) {
+        std::cerr << "Trace buffers were full, " << dropped << " zones were dropped\n";
+    }
+    if (!out) {
+        std::cerr << "Failed to write the trace " << filepath << "\n";
+        return false;
+    }
+    return true;
+}
+
+void ClearTrace()
+{
+    for (ThreadBuffer *b = buffers.load(); b; b = b->next) {
+        b->size.store(0, std::memory_order_release);
+        b->dropped.store(0, std::memory_order_relaxed);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+
+// Scoped trace zones around the widget's expensive operations, to see in a trace viewer
+// (chrome://tracing or Perfetto) whether a frame hitch came from the widget. Tracing is
+// compiled in by defining TFN_ENABLE_TRACING (the TFN_ENABLE_TRACING CMake option), without
+// it the zones compile to nothing.
+//
+// Each thread records its zones into its own buffer without locking, zones past the
+// buffer's capacity are dropped. Buffers grow as they fill, and a thread's buffer is
+// reused by a later thread once it exits, so its trace lane can show the zones of
+// several threads one after another. WriteChromeTrace can be called while other
+// threads are recording, it writes the zones they had finished by then
+#ifdef TFN_ENABLE_TRACING
+
+#include <cstdint>
+
+namespace ImTF {
+
+namespace trace {
+
+// Nanoseconds on a steady clock
+uint64_t Now();
+
+// Record a zone on the calling thread. The name must outlive the trace, e.g. a literal
+void RecordZone(const char *name, uint64_t start, uint64_t end);
+
+class Zone {
+    const char *name;
+    uint64_t start;
+
+public:
+    explicit Zone(const char *name) : name(name), start(Now()) {}
+
+    Zone(const Zone &) = delete;
+    Zone &operator=(const Zone &) = delete;
+
+    ~Zone()
+    {
+        RecordZone(name, start, Now());
+    }
+};
+
+}
+
+// Write the zones recorded by all threads as Chrome trace event JSON
+bool WriteChromeTrace(const std::string &filepath);
+
+// Discard the recorded zones. Zones still open in other threads may be kept or lost,
+// so clear the trace while the widget is idle
+void ClearTrace();
+
+}
+
+#define TFN_TRACE_CONCAT_IMPL(a, b) a##b
+#define TFN_TRACE_CONCAT(a, b) TFN_TRACE_CONCAT_IMPL(a, b)
+// Time the rest of the enclosing scope as a zone called name, which must be a literal
+#define TFN_TRACE_ZONE(name) ::ImTF::trace::Zone TFN_TRACE_CONCAT(tfn_trace_zone_, __LINE__)(name)
+
+#else
+
+namespace ImTF {
+
+inline bool WriteChromeTrace(const std::string &)
+{
+    return false;
+}
+
+inline void ClearTrace() {}
+
+}
+
+#define TFN_TRACE_ZONE(name) ((void)0)
+
+#endif
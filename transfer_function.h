@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "pixel_format.h"
+#include "table_lookup.h"
+
+namespace ImTF {
+
+// How TransferFunction looks up values between its texels
+enum LookupFilter {
+    // The texel the value falls in, as Classify does
+    LOOKUP_NEAREST,
+    // Linear interpolation between the centers of the two closest texels
+    LOOKUP_LINEAR
+};
+
+// A transfer function table of N texels stored in Format, for renderers which know the
+// table size and output format at compile time. The table size, texel size and filter
+// are constants, so the classification loops have no runtime sized steps left for the
+// compiler to unroll and vectorize. Tables are usually exported from the engine with
+// TransferFunctionEngine::Export
+template <size_t N, typename Format = RGBA8Format, LookupFilter Interp = LOOKUP_NEAREST>
+class TransferFunction {
+    static_assert(N > 0, "The table needs at least one texel");
+
+public:
+    using channel_type = typename Format::channel_type;
+
+    static constexpr size_t table_size = N;
+    static constexpr int channels = Format::channels;
+
+private:
+    std::array<channel_type, N * Format::channels> table = {};
+    // The data values mapped to the start and end of the table
+    float value_min = 0.f;
+    float value_max = 1.f;
+    float scale = static_cast<float>(N);
+
+public:
+    // Set the table from count RGBA8 texels, resampled to N texels by taking the texel
+    // under each new texel's center
+    void SetTable(const uint8_t *rgba8, size_t count)
+    {
+        if (count == 0) {
+            return;
+        }
+        for (size_t i = 0; i < N; ++i) {
+            const size_t j = count == N ? i : std::min((2 * i + 1) * count / (2 * N), count - 1);
+            const uint8_t *t = rgba8 + j * 4;
+            const uint32_t p = t[0] | (t[1] << 8) | (t[2] << 16) | (uint32_t(t[3]) << 24);
+            Format::StoreRow(&table[i * Format::channels], &p, 1);
+        }
+    }
+
+    // Set the data values mapped to the start and end of the table
+    void SetRange(float min, float max)
+    {
+        value_min = min;
+        value_max = max;
+        scale = max > min ? N / (max - min) : 0.f;
+    }
+
+    float RangeMin() const
+    {
+        return value_min;
+    }
+
+    float RangeMax() const
+    {
+        return value_max;
+    }
+
+    const std::array<channel_type, N * Format::channels> &Table() const
+    {
+        return table;
+    }
+
+    // Write the color of a value to the Format::channels elements of out. Values outside
+    // the range clamp to the ends of the table, NaNs map to the start
+    void Lookup(float value, channel_type *out) const
+    {
+        Classify(&value, 1, out);
+    }
+
+    // Classify count values read with the given stride in elements into tightly packed
+    // pixels of Format
+    void Classify(const float *values, size_t count, channel_type *out, size_t stride = 1) const
+    {
+        for (size_t begin = 0; begin < count; begin += classify_block_size) {
+            const size_t n = std::min(classify_block_size, count - begin);
+            ClassifyBlock(values + begin * stride,
+                          n,
+                          stride,
+                          out + begin * Format::channels,
+                          std::integral_constant<LookupFilter, Interp>());
+        }
+    }
+
+private:
+    void ClassifyBlock(const float *values,
+                       size_t n,
+                       size_t stride,
+                       channel_type *out,
+                       std::integral_constant<LookupFilter, LOOKUP_NEAREST>) const
+    {
+        int32_t indices[classify_block_size];
+        ComputeTableIndices(values, n, stride, value_min, scale, int32_t(N - 1), indices);
+        for (size_t i = 0; i < n; ++i) {
+            std::memcpy(out + i * Format::channels,
+                        &table[static_cast<size_t>(indices[i]) * Format::channels],
+                        Format::pixel_size);
+        }
+    }
+
+    void ClassifyBlock(const float *values,
+                       size_t n,
+                       size_t stride,
+                       channel_type *out,
+                       std::integral_constant<LookupFilter, LOOKUP_LINEAR>) const
+    {
+        // Texel i's center is at i + 0.5, so the positions are shifted by half a texel
+        // before clamping to the first and last centers
+        int32_t indices[classify_block_size];
+        float weights[classify_block_size];
+        const float max_f = static_cast<float>(N - 1);
+        for (size_t i = 0; i < n; ++i) {
+            float f = (values[i * stride] - value_min) * scale - 0.5f;
+            f = f > 0.f ? f : 0.f;
+            f = f < max_f ? f : max_f;
+            indices[i] = static_cast<int32_t>(f);
+            weights[i] = f - indices[i];
+        }
+        for (size_t i = 0; i < n; ++i) {
+            const size_t i0 = static_cast<size_t>(indices[i]);
+            const size_t i1 = i0 + (i0 < N - 1);
+            const channel_type *a = &table[i0 * Format::channels];
+            const channel_type *b = &table[i1 * Format::channels];
+            channel_type *px = out + i * Format::channels;
+            for (int c = 0; c < Format::channels; ++c) {
+                px[c] = Format::traits::Lerp(a[c], b[c], weights[i]);
+            }
+        }
+    }
+};
+
+template <size_t N, typename Format, LookupFilter Interp>
+constexpr size_t TransferFunction<N, Format, Interp>::table_size;
+
+template <size_t N, typename Format, LookupFilter Interp>
+constexpr int TransferFunction<N, Format, Interp>::channels;
+
+}
@@ -0,0 +1,231 @@
+#include "transfer_function_2d.h"
+#include <algorithm>
+#include <cmath>
+#include "table_lookup.h"
+#include "trace.h"
+
+namespace ImTF {
+
+inline int clamp_texel(int x, int size)
+{
+    return std::min(std::max(x, 0), size);
+}
+
+bool TexelRect::Empty() const
+{
+    return x0 >= x1 || y0 >= y1;
+}
+
+void TexelRect::Merge(const TexelRect &b)
+{
+    if (b.Empty()) {
+        return;
+    }
+    if (Empty()) {
+        *this = b;
+        return;
+    }
+    x0 = std::min(x0, b.x0);
+    y0 = std::min(y0, b.y0);
+    x1 = std::max(x1, b.x1);
+    y1 = std::max(y1, b.y1);
+}
+
+TransferFunction2D::TransferFunction2D(int width, int height)
+    : width(std::max(width, 1)),
+      height(std::max(height, 1)),
+      table(static_cast<size_t>(this->width) * this->height * 4, 0)
+{
+    dirty.x1 = this->width;
+    dirty.y1 = this->height;
+}
+
+int TransferFunction2D::Width() const
+{
+    return width;
+}
+
+int TransferFunction2D::Height() const
+{
+    return height;
+}
+
+size_t TransferFunction2D::NumPrimitives() const
+{
+    return primitives.size();
+}
+
+const TransferFunction2DPrimitive &TransferFunction2D::GetPrimitive(size_t i) const
+{
+    return primitives[i];
+}
+
+size_t TransferFunction2D::AddPrimitive(const TransferFunction2DPrimitive &p)
+{
+    primitives.push_back(p);
+    dirty.Merge(PrimitiveTexels(p));
+    return primitives.size() - 1;
+}
+
+void TransferFunction2D::SetPrimitive(size_t i, const TransferFunction2DPrimitive &p)
+{
+    dirty.Merge(PrimitiveTexels(primitives[i]));
+    primitives[i] = p;
+    dirty.Merge(PrimitiveTexels(p));
+}
+
+void TransferFunction2D::RemovePrimitive(size_t i)
+{
+    dirty.Merge(PrimitiveTexels(primitives[i]));
+    primitives.erase(primitives.begin() + i);
+}
+
+void TransferFunction2D::Clear()
+{
+    for (const auto &p : primitives) {
+        dirty.Merge(PrimitiveTexels(p));
+    }
+    primitives.clear();
+}
+
+TexelRect TransferFunction2D::Update()
+{
+    const TexelRect changed = dirty;
+    if (!changed.Empty()) {
+        Rasterize(changed);
+        ++version;
+        history.emplace_back(version, changed);
+        if (history.size() > 64) {
+            history.pop_front();
+        }
+    }
+    dirty = TexelRect();
+    return changed;
+}
+
+const std::vector<uint8_t> &TransferFunction2D::GetTable()
+{
+    Update();
+    return table;
+}
+
+uint64_t TransferFunction2D::Version() const
+{
+    return version;
+}
+
+TexelRect TransferFunction2D::ChangedSince(uint64_t since_version) const
+{
+    TexelRect changed;
+    if (since_version >= version) {
+        return changed;
+    }
+    if (history.empty() || history.front().first > since_version + 1) {
+        changed.x1 = width;
+        changed.y1 = height;
+        return changed;
+    }
+    for (const auto &h : history) {
+        if (h.first > since_version) {
+            changed.Merge(h.second);
+        }
+    }
+    return changed;
+}
+
+void TransferFunction2D::Classify(const float *values,
+                                  const float *gradients,
+                                  size_t count,
+                                  float value_min,
+                                  float value_max,
+                                  float gradient_max,
+                                  uint8_t *rgba,
+                                  size_t value_stride,
+                                  size_t gradient_stride)
+{
+    TFN_TRACE_ZONE("TransferFunction2D::Classify");
+    Update();
+    const float value_scale = value_max > value_min ? width / (value_max - value_min) : 0.f;
+    const float gradient_scale = gradient_max > 0.f ? height / gradient_max : 0.f;
+
+    int32_t xs[classify_block_size];
+    int32_t ys[classify_block_size];
+    for (size_t begin = 0; begin < count; begin += classify_block_size) {
+        const size_t n = std::min(classify_block_size, count - begin);
+        ComputeTableIndices(
+            values + begin * value_stride, n, value_stride, value_min, value_scale, width - 1, xs);
+        ComputeTableIndices(gradients + begin * gradient_stride,
+                            n,
+                            gradient_stride,
+                            0.f,
+                            gradient_scale,
+                            height - 1,
+                            ys);
+        for (size_t i = 0; i < n; ++i) {
+            xs[i] += ys[i] * width;
+        }
+        GatherRGBA8(table.data(), xs, n, rgba + begin * 4);
+    }
+}
+
+TexelRect TransferFunction2D::PrimitiveTexels(const TransferFunction2DPrimitive &p) const
+{
+    TexelRect r;
+    r.x0 = clamp_texel(static_cast<int>(std::floor(std::min(p.min_x, p.max_x) * width)), width);
+    r.y0 = clamp_texel(static_cast<int>(std::floor(std::min(p.min_y, p.max_y) * height)), height);
+    r.x1 = clamp_texel(static_cast<int>(std::ceil(std::max(p.min_x, p.max_x) * width)), width);
+    r.y1 = clamp_texel(static_cast<int>(std::ceil(std::max(p.min_y, p.max_y) * height)), height);
+    return r;
+}
+
+void TransferFunction2D::Rasterize(const TexelRect &rect)
+{
+    // Only the primitives overlapping the rect can contribute to it
+    std::vector<const TransferFunction2DPrimitive *> overlapping;
+    for (const auto &p : primitives) {
+        const TexelRect r = PrimitiveTexels(p);
+        if (!r.Empty() && r.x0 < rect.x1 && r.x1 > rect.x0 && r.y0 < rect.y1 && r.y1 > rect.y0) {
+            overlapping.push_back(&p);
+        }
+    }
+
+    for (int j = rect.y0; j < rect.y1; ++j) {
+        const float y = (j + 0.5f) / height;
+        uint8_t *row = table.data() + static_cast<size_t>(j) * width * 4;
+        for (int i = rect.x0; i < rect.x1; ++i) {
+            const float x = (i + 0.5f) / width;
+            // Composite the primitives in order with premultiplied alpha
+            float color[3] = {0.f, 0.f, 0.f};
+            float alpha = 0.f;
+            for (const auto *p : overlapping) {
+                const float x0 = std::min(p->min_x, p->max_x);
+                const float x1 = std::max(p->min_x, p->max_x);
+                const float y0 = std::min(p->min_y, p->max_y);
+                const float y1 = std::max(p->min_y, p->max_y);
+                if (x < x0 || x > x1 || y < y0 || y > y1) {
+                    continue;
+                }
+                float weight = 1.f;
+                if (p->type == TransferFunction2DPrimitive::TRIANGLE) {
+                    const float half_width = 0.5f * (x1 - x0) * (y - y0) / std::max(y1 - y0, 1e-6f);
+                    const float d = std::abs(x - 0.5f * (x0 + x1));
+                    weight = half_width > 0.f ? std::max(1.f - d / half_width, 0.f) : 0.f;
+                }
+                const float a = std::min(std::max(p->color[3], 0.f), 1.f) * weight;
+                for (int c = 0; c < 3; ++c) {
+                    color[c] = color[c] * (1.f - a) + p->color[c] * a;
+                }
+                alpha = alpha * (1.f - a) + a;
+            }
+
+            uint8_t *texel = row + i * 4;
+            for (int c = 0; c < 3; ++c) {
+                const float straight = alpha > 0.f ? color[c] / alpha : 0.f;
+                texel[c] = static_cast<uint8_t>(std::min(std::max(straight, 0.f), 1.f) * 255.f);
+            }
+            texel[3] = static_cast<uint8_t>(std::min(std::max(alpha, 0.f), 1.f) * 255.f);
+        }
+    }
+}
+
+}
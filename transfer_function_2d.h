@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+namespace ImTF {
+
+// A primitive of a 2D transfer function, placed by its bounding box in normalized
+// scalar value (x) and gradient magnitude (y) coordinates
+struct TransferFunction2DPrimitive {
+    enum Type {
+        // Constant color and opacity over the box
+        RECTANGLE,
+        // Apex at the bottom center of the box, widening to the full box width at
+        // the top. Opacity falls off linearly from the center line to the sides,
+        // which emphasizes boundaries around a value
+        TRIANGLE
+    };
+
+    Type type = RECTANGLE;
+    float min_x = 0.f;
+    float min_y = 0.f;
+    float max_x = 1.f;
+    float max_y = 1.f;
+    // Linear RGBA color
+    float color[4] = {1.f, 1.f, 1.f, 1.f};
+};
+
+// A rectangle of table texels [x0, x1) x [y0, y1)
+struct TexelRect {
+    int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+
+    bool Empty() const;
+
+    // Grow the rect to also cover b
+    void Merge(const TexelRect &b);
+};
+
+// A 2D transfer function indexed by scalar value and gradient magnitude, built
+// from rectangle and triangle primitives composited in order into an RGBA8 table.
+// Edits only mark the bounding boxes of the changed primitives, and only those
+// texels are re-rasterized on the next update
+class TransferFunction2D {
+    int width;
+    int height;
+    std::vector<TransferFunction2DPrimitive> primitives;
+    std::vector<uint8_t> table;
+    TexelRect dirty;
+    uint64_t version = 0;
+    // The rects rasterized by the most recent updates, tagged with the version they produced
+    std::deque<std::pair<uint64_t, TexelRect>> history;
+
+public:
+    // Create a table with width value bins and height gradient magnitude bins
+    TransferFunction2D(int width = 256, int height = 128);
+
+    int Width() const;
+
+    int Height() const;
+
+    size_t NumPrimitives() const;
+
+    const TransferFunction2DPrimitive &GetPrimitive(size_t i) const;
+
+    // Add a primitive on top of the existing ones, returns its index
+    size_t AddPrimitive(const TransferFunction2DPrimitive &p);
+
+    void SetPrimitive(size_t i, const TransferFunction2DPrimitive &p);
+
+    void RemovePrimitive(size_t i);
+
+    void Clear();
+
+    // Re-rasterize the texels touched by edits since the last update, returns the
+    // rect of texels which changed (empty if none)
+    TexelRect Update();
+
+    // Get the RGBA8 table, value along x and gradient magnitude along y. Pending
+    // edits are rasterized first
+    const std::vector<uint8_t> &GetTable();
+
+    // Incremented each time the table changes
+    uint64_t Version() const;
+
+    // The texels which changed between the given version and the current one, so
+    // consumers such as GPU textures can upload just those. If the version is too
+    // old to be tracked the whole table is returned
+    TexelRect ChangedSince(uint64_t since_version) const;
+
+    // Classify count voxels into RGBA8 colors. Values in [value_min, value_max] and
+    // gradient magnitudes in [0, gradient_max] map across the table, the inputs are
+    // read with the given strides (in elements) so interleaved data can be passed
+    void Classify(const float *values,
+                  const float *gradients,
+                  size_t count,
+                  float value_min,
+                  float value_max,
+                  float gradient_max,
+                  uint8_t *rgba,
+                  size_t value_stride = 1,
+                  size_t gradient_stride = 1);
+
+private:
+    TexelRect PrimitiveTexels(const TransferFunction2DPrimitive &p) const;
+
+    void Rasterize(const TexelRect &rect);
+};
+}
@@ -0,0 +1,1611 @@
+#include "transfer_function_engine.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <mutex>
+#include <type_traits>
+#include "curve_simplification.h"
+#include "embedded_colormaps.h"
+#include "table_lookup.h"
+#include "trace.h"
+
+#ifndef TFN_WIDGET_NO_STB_IMAGE_IMPL
+#define STB_IMAGE_IMPLEMENTATION
+#endif
+
+#include "stb_image.h"
+
+namespace ImTF {
+
+template <typename T>
+inline T clamp(T x, T min, T max)
+{
+    if (x < min) {
+        return min;
+    }
+    if (x > max) {
+        return max;
+    }
+    return x;
+}
+
+inline float srgb_to_linear(const float x)
+{
+    if (x <= 0.04045f) {
+        return x / 12.92f;
+    } else {
+        return std::pow((x + 0.055f) / 1.055f, 2.4f);
+    }
+}
+
+namespace {
+
+// Simple 5x7 bitmap font for digits and basic characters
+// Each row represents a horizontal scan line from top to bottom
+// Bits are read from MSB to LSB (left to right)
+const uint8_t font5x7[][7] = {
+    {0x70, 0x88, 0x88, 0x88, 0x88, 0x88, 0x70}, // '0'
+    {0x20, 0x60, 0x20, 0x20, 0x20, 0x20, 0x70}, // '1'
+    {0x70, 0x88, 0x08, 0x10, 0x20, 0x40, 0xF8}, // '2'
+    {0xF8, 0x10, 0x20, 0x10, 0x08, 0x88, 0x70}, // '3'
+    {0x10, 0x30, 0x50, 0x90, 0xF8, 0x10, 0x10}, // '4'
+    {0xF8, 0x80, 0xF0, 0x08, 0x08, 0x88, 0x70}, // '5'
+    {0x30, 0x40, 0x80, 0xF0, 0x88, 0x88, 0x70}, // '6'
+    {0xF8, 0x08, 0x10, 0x20, 0x40, 0x40, 0x40}, // '7'
+    {0x70, 0x88, 0x88, 0x70, 0x88, 0x88, 0x70}, // '8'
+    {0x70, 0x88, 0x88, 0x78, 0x08, 0x10, 0x60}, // '9'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // ' ' (space)
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x60}, // '.'
+    {0x00, 0x00, 0x00, 0xF8, 0x00, 0x00, 0x00}, // '-'
+    {0x70, 0x88, 0x08, 0x10, 0x20, 0x00, 0x20}, // '?'
+    {0x70, 0x88, 0x88, 0xA8, 0xA8, 0xB0, 0x70}, // '@' (used for 'e' in scientific notation)
+    {0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0xF8}, // '+' 
+};
+const int font_num_glyphs = sizeof(font5x7) / sizeof(font5x7[0]);
+
+// Character mapping
+inline int font_glyph_index(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    switch (c) {
+        case ' ': return 10;
+        case '.': return 11;
+        case '-': return 12;
+        case '?': return 13; // fallback
+        case 'e': case 'E': return 14; // for scientific notation
+        case '+': return 15;
+        default: return 13; // '?' as fallback
+    }
+}
+
+// Format a label the same way for the overlay and the batch label API
+inline int format_bitmap_number(char *buffer, size_t size, float value)
+{
+    if (std::abs(value) < 0.01f && value != 0.0f) {
+        return snprintf(buffer, size, "%.1e", value);
+    } else if (std::abs(value) >= 1000.0f) {
+        return snprintf(buffer, size, "%.1e", value);
+    }
+    return snprintf(buffer, size, "%.2f", value);
+}
+
+// Blend src over dst with the given 8-bit coverage, per RGBA8 channel
+inline uint32_t blend_rgba8(uint32_t dst, uint32_t src, uint32_t coverage)
+{
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const uint32_t d = (dst >> shift) & 0xFF;
+        const uint32_t s = (src >> shift) & 0xFF;
+        result |= ((s * coverage + d * (255 - coverage) + 127) / 255) << shift;
+    }
+    return result;
+}
+
+// The font5x7 glyphs pre-scaled to one size, stored as coverage bitmaps along with
+// the covered runs of each glyph row so labels are drawn as a few row fills
+struct GlyphAtlas {
+    struct Span {
+        int x, length;
+        bool opaque;
+    };
+
+    // Horizontal distance between characters
+    int advance = 0;
+    int width = 0;
+    int height = 0;
+    // width * height coverage values for each glyph
+    std::vector<uint8_t> coverage;
+    // The runs of row r of glyph g are spans[rows[g * height + r]] to
+    // spans[rows[g * height + r + 1]]
+    std::vector<Span> spans;
+    std::vector<size_t> rows;
+
+    GlyphAtlas(float scale, bool antialias);
+};
+
+GlyphAtlas::GlyphAtlas(float scale, bool antialias)
+{
+    // Integer scales keep the exact block size of the original font, other scales
+    // sample the font at the center of each pixel (or a 4x4 grid when antialiased)
+    const bool integral = scale == std::floor(scale);
+    advance = static_cast<int>(integral ? 6 * scale : std::lround(6 * scale));
+    width = static_cast<int>(integral ? 5 * scale : std::lround(5 * scale));
+    height = static_cast<int>(integral ? 7 * scale : std::lround(7 * scale));
+    advance = std::max(advance, 1);
+    width = std::max(width, 1);
+    height = std::max(height, 1);
+    const int samples = antialias ? 4 : 1;
+
+    coverage.resize(static_cast<size_t>(font_num_glyphs) * width * height, 0);
+    rows.reserve(font_num_glyphs * height + 1);
+    for (int g = 0; g < font_num_glyphs; ++g) {
+        uint8_t *glyph = coverage.data() + static_cast<size_t>(g) * width * height;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                int hits = 0;
+                for (int sy = 0; sy < samples; ++sy) {
+                    for (int sx = 0; sx < samples; ++sx) {
+                        const int row = static_cast<int>((y + (sy + 0.5f) / samples) / scale);
+                        const int col = static_cast<int>((x + (sx + 0.5f) / samples) / scale);
+                        if (row < 7 && col < 5 && (font5x7[g][row] & (0x80 >> col))) {
+                            ++hits;
+                        }
+                    }
+                }
+                glyph[y * width + x] = static_cast<uint8_t>(hits * 255 / (samples * samples));
+            }
+
+            rows.push_back(spans.size());
+            const uint8_t *line = glyph + y * width;
+            for (int x = 0; x < width;) {
+                if (!line[x]) {
+                    ++x;
+                    continue;
+                }
+                Span span = {x, 0, true};
+                for (; x < width && line[x]; ++x) {
+                    span.opaque = span.opaque && line[x] == 255;
+                }
+                span.length = x - span.x;
+                spans.push_back(span);
+            }
+        }
+    }
+    rows.push_back(spans.size());
+}
+
+// Atlases are shared by all widgets, keyed by scale and antialiasing. Scales are
+// rounded to 1/8 so continuously varying scales (DPI or zoom) share atlases, and only
+// the most recently used atlases are kept. Evicted atlases stay alive while a caller
+// still holds them
+std::shared_ptr<const GlyphAtlas> get_glyph_atlas(float scale, bool antialias)
+{
+    struct CachedAtlas {
+        float scale;
+        bool antialias;
+        uint64_t last_use;
+        std::shared_ptr<const GlyphAtlas> atlas;
+    };
+    const size_t max_atlases = 16;
+    static std::mutex mutex;
+    static std::vector<CachedAtlas> atlases;
+    static uint64_t use_count = 0;
+
+    scale = std::max(std::round(scale * 8.f), 1.f) / 8.f;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ++use_count;
+    for (auto &a : atlases) {
+        if (a.scale == scale && a.antialias == antialias) {
+            a.last_use = use_count;
+            return a.atlas;
+        }
+    }
+    CachedAtlas entry = {
+        scale, antialias, use_count, std::make_shared<GlyphAtlas>(scale, antialias)};
+    if (atlases.size() < max_atlases) {
+        atlases.push_back(entry);
+    } else {
+        auto oldest = std::min_element(
+            atlases.begin(), atlases.end(), [](const CachedAtlas &a, const CachedAtlas &b) {
+                return a.last_use < b.last_use;
+            });
+        *oldest = entry;
+    }
+    return entry.atlas;
+}
+
+// Draw the labels into the image with the glyph atlas. If a coverage mask is passed
+// the text color is written and its coverage recorded, otherwise the text is blended
+// into the image directly
+void draw_bitmap_labels(uint32_t *image,
+                        uint8_t *mask,
+                        int imageWidth,
+                        int imageHeight,
+                        const GlyphAtlas &atlas,
+                        const char *const *strings,
+                        const int *xs,
+                        const int *ys,
+                        size_t count,
+                        bool flip_vertically,
+                        uint32_t color)
+{
+    for (size_t l = 0; l < count; ++l) {
+        for (int c = 0; strings[l][c] != '\0'; ++c) {
+            const int glyph = font_glyph_index(strings[l][c]);
+            const int charX = xs[l] + c * atlas.advance;
+            if (charX >= imageWidth) {
+                break;
+            }
+            if (charX + atlas.width <= 0) {
+                continue;
+            }
+            const uint8_t *glyph_coverage =
+                atlas.coverage.data() + static_cast<size_t>(glyph) * atlas.width * atlas.height;
+            const int rowBegin = std::max(0, -ys[l]);
+            const int rowEnd = std::min(atlas.height, imageHeight - ys[l]);
+            for (int row = rowBegin; row < rowEnd; ++row) {
+                // When flip_vertically is true, draw from bottom to top to pre-compensate for image flip
+                const int glyphRow = flip_vertically ? atlas.height - 1 - row : row;
+                const size_t r = static_cast<size_t>(glyph) * atlas.height + glyphRow;
+                const size_t lineOffset = static_cast<size_t>(ys[l] + row) * imageWidth;
+                for (size_t s = atlas.rows[r]; s < atlas.rows[r + 1]; ++s) {
+                    const GlyphAtlas::Span &span = atlas.spans[s];
+                    const int x0 = std::max(charX + span.x, 0);
+                    const int x1 = std::min(charX + span.x + span.length, imageWidth);
+                    if (x0 >= x1) {
+                        continue;
+                    }
+                    uint32_t *dst = image + lineOffset;
+                    if (span.opaque) {
+                        std::fill(dst + x0, dst + x1, color);
+                        if (mask) {
+                            std::memset(mask + lineOffset + x0, 255, x1 - x0);
+                        }
+                        continue;
+                    }
+                    const uint8_t *src = glyph_coverage + glyphRow * atlas.width - charX;
+                    for (int x = x0; x < x1; ++x) {
+                        if (mask) {
+                            dst[x] = color;
+                            mask[lineOffset + x] = std::max(mask[lineOffset + x], src[x]);
+                        } else {
+                            dst[x] = blend_rgba8(dst[x], color, src[x]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Sample the opacity curve scaled by opacity_scale into the 8-bit alpha values in
+// [begin, end) of the npixels values written stride bytes apart
+void sample_opacity(const CurveSegments &segments,
+                    float opacity_scale,
+                    uint8_t *alpha,
+                    size_t npixels,
+                    size_t stride,
+                    size_t begin,
+                    size_t end)
+{
+    end = std::min(end, npixels);
+    if (begin >= end) {
+        return;
+    }
+    std::vector<float> opacity(end - begin);
+    SampleCurve(segments, npixels, opacity.data(), begin, end);
+    for (size_t i = begin; i < end; ++i) {
+        alpha[i * stride] = static_cast<uint8_t>(
+            clamp(opacity[i - begin] * opacity_scale * 255.f, 0.f, 255.f));
+    }
+}
+
+uint64_t steady_time_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+}
+
+// The worker rebuilding the table in the background and the latest table it completed.
+// Rebuilds are superseded by newer requests: the worker skips any queued rebuild which
+// isn't the latest, so it never falls more than one rebuild behind the UI
+struct TransferFunctionEngine::AsyncRebuild {
+    // Incremented by each rebuild request
+    std::atomic<uint64_t> generation;
+
+    std::mutex mutex;
+    std::condition_variable completed_rebuild;
+    std::vector<uint8_t> completed;
+    uint64_t completed_generation = 0;
+    uint64_t installed_generation = 0;
+
+    // Declared last so the worker is joined before the state it uses is destroyed
+    ThreadPool worker;
+
+    AsyncRebuild() : generation(0), worker(1) {}
+
+    // Skip the queued rebuilds, nothing will install them
+    ~AsyncRebuild()
+    {
+        ++generation;
+    }
+};
+
+Colormap::Colormap(const std::string &name,
+                   const std::vector<uint8_t> &img,
+                   const ColorSpace color_space)
+    : name(name), colormap(img), color_space(color_space)
+{
+}
+
+vec2f::vec2f(float c) : x(c), y(c) {}
+
+vec2f::vec2f(float x, float y) : x(x), y(y) {}
+
+float vec2f::length() const
+{
+    return std::sqrt(x * x + y * y);
+}
+
+vec2f vec2f::operator+(const vec2f &b) const
+{
+    return vec2f(x + b.x, y + b.y);
+}
+
+vec2f vec2f::operator-(const vec2f &b) const
+{
+    return vec2f(x - b.x, y - b.y);
+}
+
+vec2f vec2f::operator/(const vec2f &b) const
+{
+    return vec2f(x / b.x, y / b.y);
+}
+
+vec2f vec2f::operator*(const vec2f &b) const
+{
+    return vec2f(x * b.x, y * b.y);
+}
+
+TransferFunctionEngine::TransferFunctionEngine()
+{
+    // Load up the embedded colormaps as the default options
+    LoadEmbeddedPresets();
+
+    // Initialize the colormap alpha channel w/ a linear ramp
+    UpdateColormap();
+    SyncRecordedState();
+}
+
+TransferFunctionEngine::TransferFunctionEngine(TransferFunctionEngine &&) noexcept = default;
+
+TransferFunctionEngine &TransferFunctionEngine::operator=(TransferFunctionEngine &&) noexcept =
+    default;
+
+TransferFunctionEngine::~TransferFunctionEngine() = default;
+
+static_assert(std::is_nothrow_move_constructible<TransferFunctionEngine>::value &&
+                  std::is_nothrow_move_assignable<TransferFunctionEngine>::value,
+              "TransferFunctionEngine must stay movable");
+
+void TransferFunctionEngine::LoadEmbeddedPresets()
+{
+    TFN_TRACE_ZONE("TransferFunctionEngine::LoadEmbeddedPresets");
+    LoadEmbeddedPreset(paraview_cool_warm, sizeof(paraview_cool_warm), "ParaView Cool Warm");
+    LoadEmbeddedPreset(rainbow, sizeof(rainbow), "Rainbow");
+    LoadEmbeddedPreset(reds, sizeof(reds), "Reds");
+    LoadEmbeddedPreset(greens, sizeof(greens), "Greens");
+    LoadEmbeddedPreset(blues, sizeof(blues), "Blues");
+    LoadEmbeddedPreset(matplotlib_plasma, sizeof(matplotlib_plasma), "Matplotlib Plasma");
+    LoadEmbeddedPreset(matplotlib_virdis, sizeof(matplotlib_virdis), "Matplotlib Virdis");
+    LoadEmbeddedPreset(matplotlib_BrBg, sizeof(matplotlib_BrBg), "Matplotlib BrBg");
+    LoadEmbeddedPreset(matplotlib_terrain, sizeof(matplotlib_terrain), "Matplotlib Terrain");
+    LoadEmbeddedPreset(tacc_outlier, sizeof(tacc_outlier), "TACC Outlier");
+    LoadEmbeddedPreset(
+        samsel_linear_green, sizeof(samsel_linear_green), "Samsel Linear Green");
+    LoadEmbeddedPreset(
+        samsel_linear_ygb_1211g, sizeof(samsel_linear_ygb_1211g), "Samsel Linear YGB 1211G");
+    LoadEmbeddedPreset(cool_warm_extended, sizeof(cool_warm_extended), "Cool Warm Extended");
+    LoadEmbeddedPreset(blackbody, sizeof(blackbody), "Black Body");
+    LoadEmbeddedPreset(jet, sizeof(jet), "Jet");
+    LoadEmbeddedPreset(blue_gold, sizeof(blue_gold), "Blue Gold");
+    LoadEmbeddedPreset(ice_fire, sizeof(ice_fire), "Ice Fire");
+    LoadEmbeddedPreset(nic_edge, sizeof(nic_edge), "nic Edge");
+    LoadEmbeddedPreset(cube_helix, sizeof(cube_helix), "Cube Helix");
+    LoadEmbeddedPreset(linear_grayscale, sizeof(linear_grayscale), "Linear Grayscale");
+    LoadEmbeddedPreset(flat_red, sizeof(flat_red), "flat red");
+    LoadEmbeddedPreset(flat_green, sizeof(flat_green), "flat green");
+    LoadEmbeddedPreset(flat_blue, sizeof(flat_blue), "flat blue");
+}
+
+void TransferFunctionEngine::AddColormap(const Colormap &map)
+{
+    colormaps.push_back(map);
+
+    if (colormaps.back().color_space == SRGB) {
+        Colormap &cmap = colormaps.back();
+        cmap.color_space = LINEAR;
+        for (size_t i = 0; i < cmap.colormap.size() / 4; ++i) {
+            for (size_t j = 0; j < 3; ++j) {
+                const float x = srgb_to_linear(cmap.colormap[i * 4 + j] / 255.f);
+                cmap.colormap[i * 4 + j] = static_cast<uint8_t>(clamp(x * 255.f, 0.f, 255.f));
+            }
+        }
+    }
+}
+
+const PerformanceCounters &TransferFunctionEngine::GetPerformanceCounters() const
+{
+    return perf_counters;
+}
+
+void TransferFunctionEngine::ResetPerformanceCounters()
+{
+    perf_counters = PerformanceCounters();
+}
+
+void TransferFunctionEngine::CountAllocation(size_t bytes) const
+{
+    ++perf_counters.allocations;
+    perf_counters.allocated_bytes += bytes;
+}
+
+void TransferFunctionEngine::SetAutoRangePercentiles(float lower, float upper)
+{
+    auto_range_percentiles.x = clamp(std::min(lower, upper), 0.f, 100.f);
+    auto_range_percentiles.y = clamp(std::max(lower, upper), 0.f, 100.f);
+}
+
+bool TransferFunctionEngine::AutoRange(const QuantileSketch &sketch, vec2f dataRange)
+{
+    const float span = dataRange.y - dataRange.x;
+    if (sketch.Empty() || !(span > 0.f))
+    {
+        return false;
+    }
+    const float lo = sketch.Quantile(auto_range_percentiles.x / 100.0);
+    const float hi = sketch.Quantile(auto_range_percentiles.y / 100.0);
+    range.x = clamp((lo - dataRange.x) / span, 0.f, 1.f);
+    range.y = clamp((hi - dataRange.x) / span, 0.f, 1.f);
+    range.x = std::min(range.x, range.y-1e-6f);
+    range.y = std::max(range.x+1e-6f, range.y);
+    NotifyChanged(CHANGED_RANGE);
+    PublishSnapshot();
+    RecordEdit();
+    return true;
+}
+
+void TransferFunctionEngine::OverlayColormapBar(std::vector<uint32_t>& image, int imageWidth, int imageHeight, 
+                                               vec2f pos, vec2f dataRange, float scale, bool flip_vertically,
+                                               bool antialias_labels)
+{
+    OverlayColormapBar<RGBA8Format>(reinterpret_cast<uint8_t *>(image.data()),
+                                    imageWidth,
+                                    imageHeight,
+                                    0,
+                                    pos,
+                                    dataRange,
+                                    scale,
+                                    flip_vertically,
+                                    OVERLAY_OVERWRITE,
+                                    antialias_labels);
+}
+
+ThreadPool &TransferFunctionEngine::OverlayPool(unsigned num_threads)
+{
+    if (num_threads == 0) {
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    if (!overlay_pool || overlay_pool->Size() != num_threads) {
+        overlay_pool.reset();
+        overlay_pool.reset(new ThreadPool(num_threads));
+    }
+    return *overlay_pool;
+}
+
+std::shared_ptr<const TransferFunctionEngine::ColorbarSprite>
+TransferFunctionEngine::PrepareColorbarSprite(
+    int imageWidth,
+    int imageHeight,
+    vec2f pos,
+    vec2f dataRange,
+    float scale,
+    bool flip_vertically,
+    bool antialias,
+    int &originX,
+    int &originY)
+{
+    const int barHeight = static_cast<int>(200 * scale);
+
+    // Calculate bar position using distance from bottom-left corner
+    // pos.x is distance from left edge, pos.y is distance from bottom edge
+    // Account for vertical flipping if enabled
+    int barX = static_cast<int>(pos.x);
+    int barY;
+    if (flip_vertically) {
+        // When vertically flipped, top becomes bottom, so use pos.y directly from top
+        barY = static_cast<int>(pos.y);
+    } else {
+        // Normal case: convert from bottom-left to top-left coordinates
+        barY = imageHeight - static_cast<int>(pos.y) - barHeight;
+    }
+    
+    // Skip if bar would be outside the image
+    if (barX < 0 || barY < 0 || pos.x >= imageWidth || pos.y >= imageHeight) return nullptr;
+    if (current_colormap.empty()) return nullptr;
+
+    // Calculate the actual data range that the transfer function covers. The range
+    // and colormap are read directly so overlaying doesn't clear the changed flags
+    const float dataSpan = dataRange.y - dataRange.x;
+    const float actualMin = dataRange.x + range.x * dataSpan;
+    const float actualMax = dataRange.x + range.y * dataSpan;
+
+    if (!colorbar_sprite || colorbar_sprite->colormap_version != colormap_version ||
+        colorbar_sprite->scale != scale || colorbar_sprite->value_min != actualMin ||
+        colorbar_sprite->value_max != actualMax ||
+        colorbar_sprite->flip_vertically != flip_vertically ||
+        colorbar_sprite->antialias != antialias) {
+        colorbar_sprite =
+            BuildColorbarSprite(actualMin, actualMax, scale, flip_vertically, antialias);
+    }
+    originX = barX + colorbar_sprite->x;
+    originY = barY + colorbar_sprite->y;
+    return colorbar_sprite;
+}
+
+void TransferFunctionEngine::DrawBitmapNumbers(std::vector<uint32_t> &image,
+                                               int imageWidth,
+                                               int imageHeight,
+                                               const std::vector<BitmapLabel> &labels,
+                                               float scale,
+                                               bool flip_vertically,
+                                               bool antialias,
+                                               uint32_t color)
+{
+    if (labels.empty() || scale <= 0.f) {
+        return;
+    }
+    std::vector<std::array<char, 32>> buffers(labels.size());
+    std::vector<const char *> strings(labels.size());
+    std::vector<int> xs(labels.size());
+    std::vector<int> ys(labels.size());
+    for (size_t i = 0; i < labels.size(); ++i) {
+        format_bitmap_number(buffers[i].data(), buffers[i].size(), labels[i].value);
+        strings[i] = buffers[i].data();
+        xs[i] = labels[i].x;
+        ys[i] = labels[i].y;
+    }
+    draw_bitmap_labels(image.data(),
+                       nullptr,
+                       imageWidth,
+                       imageHeight,
+                       *get_glyph_atlas(scale, antialias),
+                       strings.data(),
+                       xs.data(),
+                       ys.data(),
+                       labels.size(),
+                       flip_vertically,
+                       color);
+}
+
+std::shared_ptr<const TransferFunctionEngine::ColorbarSprite>
+TransferFunctionEngine::BuildColorbarSprite(float value_min,
+                                            float value_max,
+                                            float scale,
+                                            bool flip_vertically,
+                                            bool antialias) const
+{
+    // Base dimensions for the colormap bar
+    const int baseBarWidth = 40;
+    const int baseBarHeight = 200;
+    const int baseTickLength = 8;
+    const int numTicks = 5; // Including min and max
+
+    // Scale the dimensions
+    const int barWidth = static_cast<int>(baseBarWidth * scale);
+    const int barHeight = static_cast<int>(baseBarHeight * scale);
+    const int tickLength = static_cast<int>(baseTickLength * scale);
+    const float valueSpan = value_max - value_min;
+
+    auto sprite = std::make_shared<ColorbarSprite>();
+    sprite->colormap_version = colormap_version;
+    sprite->scale = scale;
+    sprite->value_min = value_min;
+    sprite->value_max = value_max;
+    sprite->flip_vertically = flip_vertically;
+    sprite->antialias = antialias;
+    if (scale <= 0.f) {
+        sprite->rows.push_back(0);
+        return sprite;
+    }
+    const GlyphAtlas &atlas = *get_glyph_atlas(scale, antialias);
+
+    // Tick positions and labels relative to the top of the bar, labels start 4
+    // pixels above their tick
+    char labels[numTicks][32];
+    const char *strings[numTicks];
+    int labelX[numTicks];
+    int labelY[numTicks];
+    int tickY[numTicks];
+    int labelWidth = 0;
+    for (int tick = 0; tick < numTicks; ++tick) {
+        float t = static_cast<float>(tick) / (numTicks - 1);
+        if (flip_vertically) {
+            // When flipped, tick=0 should be at top (min value), tick=numTicks-1 should be at bottom (max value)
+            tickY[tick] = static_cast<int>(t * (barHeight - 1));
+        } else {
+            // Normal case: tick=0 should be at bottom (min value), tick=numTicks-1 should be at top (max value)
+            tickY[tick] = barHeight - 1 - static_cast<int>(t * (barHeight - 1));
+        }
+        const int length = format_bitmap_number(labels[tick], sizeof(labels[tick]), value_min + t * valueSpan);
+        strings[tick] = labels[tick];
+        labelX[tick] = barWidth + tickLength + 2;
+        labelY[tick] = tickY[tick] - 4;
+        labelWidth = std::max(labelWidth, std::max(length, 0) * atlas.advance);
+    }
+
+    const int minLabelY = *std::min_element(labelY, labelY + numTicks);
+    const int maxLabelY = *std::max_element(labelY, labelY + numTicks);
+    sprite->x = 0;
+    sprite->y = std::min(0, minLabelY);
+    sprite->width = std::max(barWidth + tickLength, labelX[0] + labelWidth);
+    sprite->height = std::max(barHeight, maxLabelY + atlas.height) - sprite->y;
+
+    const int w = sprite->width;
+    const int h = sprite->height;
+    const int oy = -sprite->y;
+    std::vector<uint32_t> &pixels = sprite->pixels;
+    std::vector<uint8_t> &covered = sprite->coverage;
+    covered.resize(static_cast<size_t>(w) * h, 0);
+    pixels.resize(covered.size(), 0);
+
+    auto fill_row = [&](int y, int x0, int x1, uint32_t color) {
+        x0 = std::max(x0, 0);
+        x1 = std::min(x1, w);
+        if (y < 0 || y >= h || x0 >= x1) {
+            return;
+        }
+        std::fill(pixels.begin() + y * w + x0, pixels.begin() + y * w + x1, color);
+        std::fill(covered.begin() + y * w + x0, covered.begin() + y * w + x1, 255);
+    };
+
+    // Draw the colormap bar (vertical)
+    const int numEntries = static_cast<int>(current_colormap.size() / 4);
+    for (int y = 0; y < barHeight; ++y) {
+        // Map y position to colormap index 
+        // Account for vertical flipping
+        float t;
+        if (flip_vertically) {
+            // When flipped, y=0 (top of bar) should show minimum value (t=0)
+            // y=barHeight-1 (bottom of bar) should show maximum value (t=1)
+            t = (float)y / (barHeight - 1);
+        } else {
+            // Normal case: y=0 (top of bar) should show maximum value (t=1)
+            // y=barHeight-1 (bottom of bar) should show minimum value (t=0)
+            t = 1.0f - (float)y / (barHeight - 1);
+        }
+        int cmapIndex = static_cast<int>(t * (numEntries - 1)) * 4;
+        cmapIndex = std::max(0, std::min(cmapIndex, static_cast<int>(current_colormap.size()) - 4));
+
+        // Extract RGBA values from colormap
+        uint8_t r = current_colormap[cmapIndex + 0];
+        uint8_t g = current_colormap[cmapIndex + 1];
+        uint8_t b = current_colormap[cmapIndex + 2];
+        uint8_t a = current_colormap[cmapIndex + 3];
+
+        // Convert to uint32_t (assuming RGBA format)
+        uint32_t color = (a << 24) | (b << 16) | (g << 8) | r;
+        fill_row(y + oy, 0, barWidth, color);
+    }
+
+    // Draw tick marks (white lines extending to the right) and their labels
+    uint32_t white = 0xFFFFFFFF;
+    for (int tick = 0; tick < numTicks; ++tick) {
+        fill_row(tickY[tick] + oy, barWidth, barWidth + tickLength, white);
+        labelY[tick] += oy;
+    }
+    draw_bitmap_labels(pixels.data(),
+                       covered.data(),
+                       w,
+                       h,
+                       atlas,
+                       strings,
+                       labelX,
+                       labelY,
+                       numTicks,
+                       flip_vertically,
+                       white);
+
+    // Draw border around the colormap bar
+    fill_row(oy, 0, barWidth, white);
+    fill_row(barHeight - 1 + oy, 0, barWidth, white);
+    for (int y = 0; y < barHeight; ++y) {
+        fill_row(y + oy, 0, std::min(1, barWidth), white);
+        fill_row(y + oy, barWidth - 1, barWidth, white);
+    }
+
+    // Collect the covered runs of each row for compositing
+    sprite->rows.reserve(h + 1);
+    for (int y = 0; y < h; ++y) {
+        sprite->rows.push_back(sprite->spans.size());
+        const uint8_t *mask = covered.data() + static_cast<size_t>(y) * w;
+        for (int x = 0; x < w;) {
+            if (!mask[x]) {
+                ++x;
+                continue;
+            }
+            ColorbarSprite::Span span = {x, 0, true};
+            for (; x < w && mask[x]; ++x) {
+                span.opaque = span.opaque && mask[x] == 255;
+            }
+            span.length = x - span.x;
+            sprite->spans.push_back(span);
+        }
+    }
+    sprite->rows.push_back(sprite->spans.size());
+    return sprite;
+}
+
+bool TransferFunctionEngine::LoadState(const std::string &filepath)
+{
+    TFN_TRACE_ZONE("TransferFunctionEngine::LoadState");
+    // Read the file
+    std::ifstream fp;
+    fp.open(filepath, std::ios::in | std::ios::binary);
+    if (!fp.is_open()) {
+        printf("Could not open file %s\n", filepath.c_str());
+        return false;
+    }
+
+    // Read the opacity scale
+    fp >> opacity_scale;
+
+    // Read the range
+    fp >> range.x >> range.y;
+
+    // Read the current colormap size
+    uint32_t current_colormap_size;
+    fp >> current_colormap_size;
+    fp.ignore();  // Ignore the newline character
+
+    // Read the current colormap
+    current_colormap.clear();
+    current_colormap.resize(current_colormap_size);
+    fp.read(reinterpret_cast<char*>(current_colormap.data()), current_colormap_size * sizeof(uint8_t));
+
+    std::string colormap_name;
+    std::getline(fp, colormap_name);  // Read the entire line as the colormap name
+
+    // If the colormap name is not "custom," then look through the list of colormaps
+    // names and set the selected_colormap variable to its index
+    if (colormap_name != "custom") {
+        for (int i = 0; i < colormaps.size(); i++) {
+            if (colormaps[i].name == colormap_name) {
+                selected_colormap = i;
+                break;
+            }
+        }
+    }
+    else {
+        LoadEmbeddedPreset(reinterpret_cast<uint8_t*>(current_colormap.data()), current_colormap.size(), "custom");
+    }
+
+    // Read the control points
+    size_t num_pts;
+    fp >> num_pts;
+    alpha_control_pts.clear();
+    alpha_control_pts.resize(num_pts);
+    for (auto &pt : alpha_control_pts) {
+        fp >> pt.x;
+        fp >> pt.y;
+    }
+    // Read the interpolation modes, files saved before they were added end here
+    alpha_control_modes.assign(num_pts, INTERP_LINEAR);
+    for (auto &mode : alpha_control_modes) {
+        int m;
+        if (!(fp >> m)) {
+            break;
+        }
+        mode = static_cast<InterpolationMode>(clamp(m, 0, NUM_INTERPOLATION_MODES - 1));
+    }
+    fp.close();
+    printf("Transferfunction read from file %s\n", filepath.c_str());
+    UpdateColormap();
+    RecordEdit();
+    return true;
+}
+
+bool TransferFunctionEngine::SaveState(const std::string &filepath)
+{
+    TFN_TRACE_ZONE("TransferFunctionEngine::SaveState");
+    //create file and write to it
+    std::ofstream fp;
+    fp.open(filepath, std::ios::out | std::ios::binary);
+    //clear the file
+    fp.clear();
+
+    if (!fp.is_open()) {
+        printf("Could not open file %s\n", filepath.c_str());
+        return false;
+    }
+    fp << opacity_scale << std::endl << range.x << " " << range.y << std::endl;
+    fp << current_colormap.size() << std::endl;
+
+    // Write the color map as binary data
+    fp.write(reinterpret_cast<char*>(current_colormap.data()), current_colormap.size() * sizeof(uint8_t));
+
+    //write the name of the colormap
+    if (selected_colormap >= 0 && selected_colormap < colormaps.size())
+        fp << colormaps[selected_colormap].name << std::endl;
+    else
+        fp << "custom" << std::endl;
+
+    //write control point positions
+    fp << alpha_control_pts.size() << std::endl;
+    for (const auto &pt : alpha_control_pts) {
+        fp << pt.x << " " << pt.y << std::endl;
+    }
+    //write the segment interpolation modes
+    for (const auto &mode : alpha_control_modes) {
+        fp << static_cast<int>(mode) << " ";
+    }
+    fp << std::endl;
+    fp.close();
+    printf("Transferfunction written to file %s\n", filepath.c_str());
+    return true;
+}
+
+bool TransferFunctionEngine::Changed() const
+{
+    return colormap_changed || opacity_scale_changed || range_changed;
+}
+
+bool TransferFunctionEngine::ColorMapChanged() const
+{
+    return colormap_changed;
+}
+
+bool TransferFunctionEngine::OpacityScaleChanged() const
+{
+    return opacity_scale_changed;
+}
+
+bool TransferFunctionEngine::RangeChanged() const
+{
+    return range_changed;
+}
+
+std::vector<uint8_t> TransferFunctionEngine::GetColormap()
+{
+    PollRebuild();
+    colormap_changed = false;
+    return current_colormap;
+}
+
+const std::vector<uint8_t> &TransferFunctionEngine::ColormapTable() const
+{
+    return current_colormap;
+}
+
+uint64_t TransferFunctionEngine::ColormapVersion() const
+{
+    return colormap_version;
+}
+
+std::vector<float> TransferFunctionEngine::GetColormapf()
+{
+    PollRebuild();
+    colormap_changed = false;
+    std::vector<float> colormapf(current_colormap.size(), 0.f);
+    for (size_t i = 0; i < current_colormap.size(); ++i) {
+        colormapf[i] = current_colormap[i] / 255.f;
+    }
+    return colormapf;
+}
+
+void TransferFunctionEngine::GetColormapf(std::vector<float> &color,
+                                           std::vector<float> &opacity)
+{
+    PollRebuild();
+    colormap_changed = false;
+    color.resize((current_colormap.size() / 4) * 3);
+    opacity.resize(current_colormap.size() / 4);
+    for (size_t i = 0; i < current_colormap.size() / 4; ++i) {
+        color[i * 3] = current_colormap[i * 4] / 255.f;
+        color[i * 3 + 1] = current_colormap[i * 4 + 1] / 255.f;
+        color[i * 3 + 2] = current_colormap[i * 4 + 2] / 255.f;
+        opacity[i] = current_colormap[i * 4 + 3] / 255.f;
+    }
+}
+
+void TransferFunctionEngine::Classify(const float *values,
+                                      size_t count,
+                                      vec2f dataRange,
+                                      uint8_t *rgba,
+                                      size_t stride,
+                                      size_t rgba_stride)
+{
+    TFN_TRACE_ZONE("TransferFunctionEngine::Classify");
+    PollRebuild();
+    ClassifyValues(values, count, dataRange, rgba, stride, rgba_stride);
+}
+
+void TransferFunctionEngine::ClassifyValues(const float *values,
+                                            size_t count,
+                                            vec2f dataRange,
+                                            uint8_t *rgba,
+                                            size_t stride,
+                                            size_t rgba_stride) const
+{
+    const size_t npixels = current_colormap.size() / 4;
+    if (npixels == 0) {
+        return;
+    }
+    // The data values the ends of the table map to
+    const float dataSpan = dataRange.y - dataRange.x;
+    const float lo = dataRange.x + range.x * dataSpan;
+    const float hi = dataRange.x + range.y * dataSpan;
+    const float scale = hi > lo ? npixels / (hi - lo) : 0.f;
+
+    int32_t indices[classify_block_size];
+    for (size_t begin = 0; begin < count; begin += classify_block_size) {
+        const size_t n = std::min(classify_block_size, count - begin);
+        ComputeTableIndices(values + begin * stride,
+                            n,
+                            stride,
+                            lo,
+                            scale,
+                            static_cast<int32_t>(npixels - 1),
+                            indices);
+        GatherRGBA8(current_colormap.data(), indices, n, rgba + begin * rgba_stride, rgba_stride);
+    }
+}
+
+void TransferFunctionEngine::SetOpacityScale(float scale)
+{
+    opacity_scale = clamp(scale, 0.f, 1.f);
+    NotifyChanged(CHANGED_OPACITY_SCALE);
+    UpdateColormap();
+    RecordEdit();
+}
+
+void TransferFunctionEngine::SetUpdatePolicy(UpdatePolicy policy, float rate)
+{
+    update_policy = policy;
+    update_rate = rate;
+    // Report anything held back under the old policy
+    HoldUpdates(false);
+}
+
+UpdatePolicy TransferFunctionEngine::GetUpdatePolicy() const
+{
+    return update_policy;
+}
+
+bool TransferFunctionEngine::UpdatesHeld() const
+{
+    return updates_held;
+}
+
+float TransferFunctionEngine::GetOpacityScale()
+{
+    opacity_scale_changed = false;
+    return opacity_scale;
+}
+
+vec2f TransferFunctionEngine::GetRange()
+{
+    range_changed = false;
+    return range;
+}
+
+void TransferFunctionEngine::UpdateColormap()
+{
+    TFN_TRACE_ZONE("TransferFunctionEngine::UpdateColormap");
+    if (async_rebuild) {
+        ComputeOpacitySegments(alpha_control_pts, alpha_control_modes, alpha_segments);
+        RequestRebuild();
+        return;
+    }
+    ScopedTimer timer(perf_counters.update_colormap);
+    ++colormap_version;
+    ++state_version;
+    NotifyChanged(CHANGED_COLORMAP);
+    const std::vector<uint8_t> &colors = colormaps[selected_colormap].colormap;
+    if (current_colormap.capacity() < colors.size()) {
+        CountAllocation(colors.size());
+    }
+    current_colormap = colors;
+    // We only change opacities for now, so go through and update the opacity
+    // from the curve's segments
+    ComputeOpacitySegments(alpha_control_pts, alpha_control_modes, alpha_segments);
+    SampleOpacity(alpha_segments, current_colormap.data() + 3, current_colormap.size() / 4, 4);
+    ++perf_counters.table_rebuilds;
+    perf_counters.texels_recomputed += current_colormap.size() / 4;
+    PublishSnapshot();
+}
+
+void TransferFunctionEngine::SortControlPoints()
+{
+    // Sort a permutation of the points and apply it to both the points and modes
+    std::vector<size_t> order(alpha_control_pts.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) {
+        return alpha_control_pts[a].x < alpha_control_pts[b].x;
+    });
+    std::vector<vec2f> pts(order.size());
+    std::vector<InterpolationMode> modes(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        pts[i] = alpha_control_pts[order[i]];
+        modes[i] = alpha_control_modes[order[i]];
+    }
+    alpha_control_pts.swap(pts);
+    alpha_control_modes.swap(modes);
+}
+
+void TransferFunctionEngine::ComputeOpacitySegments(const std::vector<vec2f> &pts,
+                                                    const std::vector<InterpolationMode> &modes,
+                                                    CurveSegments &segments)
+{
+    std::vector<float> xs(pts.size());
+    std::vector<float> ys(pts.size());
+    for (size_t i = 0; i < pts.size(); ++i) {
+        xs[i] = pts[i].x;
+        ys[i] = pts[i].y;
+    }
+    ComputeCurveSegments(xs.data(), ys.data(), modes.data(), pts.size(), segments);
+}
+
+void TransferFunctionEngine::SampleOpacity(const CurveSegments &segments,
+                                           uint8_t *alpha,
+                                           size_t npixels,
+                                           size_t stride,
+                                           size_t begin,
+                                           size_t end) const
+{
+    // The opacities are sampled into a temporary buffer first
+    if (begin < std::min(end, npixels)) {
+        CountAllocation((std::min(end, npixels) - begin) * sizeof(float));
+    }
+    sample_opacity(segments, opacity_scale, alpha, npixels, stride, begin, end);
+}
+
+void TransferFunctionEngine::UpdateColormapOpacity()
+{
+    TFN_TRACE_ZONE("TransferFunctionEngine::UpdateColormapOpacity");
+    if (async_rebuild) {
+        ComputeOpacitySegments(alpha_control_pts, alpha_control_modes, alpha_segments);
+        RequestRebuild();
+        return;
+    }
+    ScopedTimer timer(perf_counters.update_colormap);
+    CurveSegments segments;
+    ComputeOpacitySegments(alpha_control_pts, alpha_control_modes, segments);
+
+    // Find the segments which changed by trimming those matching at either end
+    const CurveSegments &old = alpha_segments;
+    const size_t n_old = old.Size();
+    const size_t n_new = segments.Size();
+    auto same = [&](size_t i, size_t j) {
+        return old.x0[i] == segments.x0[j] && old.inv_width[i] == segments.inv_width[j] &&
+               old.c0[i] == segments.c0[j] && old.c1[i] == segments.c1[j] &&
+               old.c2[i] == segments.c2[j] && old.c3[i] == segments.c3[j];
+    };
+    const size_t n_min = std::min(n_old, n_new);
+    size_t prefix = 0;
+    while (prefix < n_min && same(prefix, prefix)) {
+        ++prefix;
+    }
+    size_t suffix = 0;
+    while (suffix < n_min - prefix && same(n_old - 1 - suffix, n_new - 1 - suffix)) {
+        ++suffix;
+    }
+    if (prefix == n_min && n_old == n_new) {
+        return;
+    }
+
+    // The table entries covered by the changed segments before or after the edit
+    auto span_start = [](const CurveSegments &c, size_t i) {
+        return i < c.Size() ? c.x0[i] : 1.f;
+    };
+    const float lo = std::min(span_start(old, prefix), span_start(segments, prefix));
+    const float hi = std::max(span_start(old, n_old - suffix), span_start(segments, n_new - suffix));
+    alpha_segments = std::move(segments);
+
+    const size_t npixels = current_colormap.size() / 4;
+    const size_t begin = static_cast<size_t>(clamp(lo, 0.f, 1.f) * npixels);
+    const size_t end = std::min(npixels, static_cast<size_t>(clamp(hi, 0.f, 1.f) * npixels) + 2);
+    SampleOpacity(alpha_segments, current_colormap.data() + 3, npixels, 4, begin, end);
+    ++perf_counters.partial_table_updates;
+    perf_counters.texels_recomputed += end - begin;
+
+    ++colormap_version;
+    ++state_version;
+    NotifyChanged(CHANGED_COLORMAP);
+    PublishSnapshot();
+}
+
+TransferFunctionState TransferFunctionEngine::GetState() const
+{
+    TransferFunctionState state;
+    for (size_t i = 0; i < alpha_control_pts.size(); ++i) {
+        state.control_x.push_back(alpha_control_pts[i].x);
+        state.control_y.push_back(alpha_control_pts[i].y);
+        state.modes.push_back(alpha_control_modes[i]);
+    }
+    state.range_min = range.x;
+    state.range_max = range.y;
+    state.opacity_scale = opacity_scale;
+    state.colors = colormaps[selected_colormap].colormap;
+    return state;
+}
+
+void TransferFunctionEngine::SetState(const TransferFunctionState &state)
+{
+    const size_t n = std::min(state.control_x.size(), state.control_y.size());
+    if (n < 2 || state.colors.size() < 4) {
+        std::cerr << "TransferFunctionEngine::SetState() needs two control points and colors\n";
+        return;
+    }
+    alpha_control_pts.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        alpha_control_pts[i] = vec2f(state.control_x[i], state.control_y[i]);
+    }
+    alpha_control_modes = state.modes;
+    alpha_control_modes.resize(n, INTERP_LINEAR);
+    SortControlPoints();
+    control_points_replaced = true;
+    range = vec2f(state.range_min, state.range_max);
+    opacity_scale = state.opacity_scale;
+
+    // Use the colormap with the same colors if there's one
+    auto same_colors = [&](const std::vector<uint8_t> &colors) {
+        if (colors.size() != state.colors.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < colors.size(); ++i) {
+            if (i % 4 != 3 && colors[i] != state.colors[i]) {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto fnd = std::find_if(colormaps.begin(), colormaps.end(), [&](const Colormap &c) {
+        return same_colors(c.colormap);
+    });
+    if (fnd != colormaps.end()) {
+        selected_colormap = std::distance(colormaps.begin(), fnd);
+    } else {
+        std::vector<uint8_t> colors(state.colors.begin(), state.colors.end() - state.colors.size() % 4);
+        for (size_t i = 3; i < colors.size(); i += 4) {
+            colors[i] = 255;
+        }
+        if (state_colormap < colormaps.size()) {
+            colormaps[state_colormap].colormap = colors;
+        } else {
+            colormaps.emplace_back("Keyframe", colors, LINEAR);
+            state_colormap = colormaps.size() - 1;
+        }
+        selected_colormap = state_colormap;
+    }
+
+    NotifyChanged(CHANGED_RANGE | CHANGED_OPACITY_SCALE);
+    UpdateColormap();
+    RecordEdit();
+}
+
+size_t TransferFunctionEngine::StateEdit::Bytes() const
+{
+    return sizeof(StateEdit) + (old_pts.size() + new_pts.size()) * sizeof(vec2f) +
+           (old_modes.size() + new_modes.size()) * sizeof(InterpolationMode) +
+           old_state_colors.size() + new_state_colors.size();
+}
+
+void TransferFunctionEngine::RecordEdit(bool in_progress)
+{
+    HoldUpdates(in_progress);
+    if (in_progress) {
+        return;
+    }
+    // Changes to the points, opacity scale or colormap all update the colormap
+    const bool range_edited = range.x != recorded_range.x || range.y != recorded_range.y;
+    if (state_version == recorded_version && !range_edited) {
+        return;
+    }
+
+    StateEdit edit;
+    if (selected_colormap != recorded_colormap) {
+        edit.fields |= StateEdit::COLORMAP;
+        edit.old_colormap = recorded_colormap;
+        edit.new_colormap = selected_colormap;
+    }
+    // The state colormap is only compared once it existed at the last recorded edit,
+    // undoing its creation just selects the previous colormap again
+    if (!recorded_state_colors.empty() &&
+        colormaps[state_colormap].colormap != recorded_state_colors) {
+        edit.fields |= StateEdit::STATE_COLORS;
+        edit.old_state_colors = recorded_state_colors;
+        edit.new_state_colors = colormaps[state_colormap].colormap;
+    }
+    if (opacity_scale != recorded_opacity_scale) {
+        edit.fields |= StateEdit::OPACITY_SCALE;
+        edit.old_opacity_scale = recorded_opacity_scale;
+        edit.new_opacity_scale = opacity_scale;
+    }
+    if (range_edited) {
+        edit.fields |= StateEdit::RANGE;
+        edit.old_range = recorded_range;
+        edit.new_range = range;
+    }
+
+    // Only store the span of control points which changed
+    const size_t n_old = recorded_pts.size();
+    const size_t n_new = alpha_control_pts.size();
+    auto same = [&](size_t i, size_t j) {
+        return recorded_pts[i].x == alpha_control_pts[j].x &&
+               recorded_pts[i].y == alpha_control_pts[j].y &&
+               recorded_modes[i] == alpha_control_modes[j];
+    };
+    const size_t n_min = std::min(n_old, n_new);
+    size_t prefix = 0;
+    while (prefix < n_min && same(prefix, prefix)) {
+        ++prefix;
+    }
+    size_t suffix = 0;
+    while (suffix < n_min - prefix && same(n_old - 1 - suffix, n_new - 1 - suffix)) {
+        ++suffix;
+    }
+    if (prefix != n_min || n_old != n_new) {
+        edit.fields |= StateEdit::POINTS;
+        edit.point_offset = prefix;
+        edit.old_pts.assign(recorded_pts.begin() + prefix, recorded_pts.end() - suffix);
+        edit.new_pts.assign(alpha_control_pts.begin() + prefix, alpha_control_pts.end() - suffix);
+        edit.old_modes.assign(recorded_modes.begin() + prefix, recorded_modes.end() - suffix);
+        edit.new_modes.assign(alpha_control_modes.begin() + prefix,
+                              alpha_control_modes.end() - suffix);
+    }
+
+    if (edit.fields) {
+        CountAllocation(edit.Bytes());
+        history.Push(std::move(edit));
+    }
+    SyncRecordedState();
+}
+
+void TransferFunctionEngine::SyncRecordedState()
+{
+    recorded_pts = alpha_control_pts;
+    recorded_modes = alpha_control_modes;
+    recorded_range = range;
+    recorded_opacity_scale = opacity_scale;
+    recorded_colormap = selected_colormap;
+    if (state_colormap < colormaps.size()) {
+        recorded_state_colors = colormaps[state_colormap].colormap;
+    }
+    recorded_version = state_version;
+}
+
+void TransferFunctionEngine::NotifyChanged(uint32_t changes)
+{
+    if (updates_held) {
+        held_changes |= changes;
+        return;
+    }
+    colormap_changed |= (changes & CHANGED_COLORMAP) != 0;
+    opacity_scale_changed |= (changes & CHANGED_OPACITY_SCALE) != 0;
+    range_changed |= (changes & CHANGED_RANGE) != 0;
+    if (update_policy == UPDATE_RATE_LIMITED) {
+        last_update_time = steady_time_ns();
+    }
+}
+
+void TransferFunctionEngine::HoldUpdates(bool in_progress)
+{
+    bool hold = false;
+    if (in_progress && update_policy == UPDATE_ON_RELEASE) {
+        hold = true;
+    } else if (in_progress && update_policy == UPDATE_RATE_LIMITED) {
+        const double period_ns = update_rate > 0.f ? 1e9 / update_rate : 0.0;
+        hold = steady_time_ns() - last_update_time < period_ns;
+    }
+    if (hold == updates_held && (hold || !held_changes)) {
+        return;
+    }
+    updates_held = hold;
+    if (!hold) {
+        const uint32_t changes = held_changes;
+        held_changes = 0;
+        if (changes) {
+            NotifyChanged(changes);
+        }
+        PublishSnapshot();
+    }
+}
+
+void TransferFunctionEngine::ApplyEdit(const StateEdit &edit, bool undo)
+{
+    if (edit.fields & StateEdit::POINTS) {
+        const auto &remove_pts = undo ? edit.new_pts : edit.old_pts;
+        const auto &insert_pts = undo ? edit.old_pts : edit.new_pts;
+        const auto &insert_modes = undo ? edit.old_modes : edit.new_modes;
+        auto pts_at = alpha_control_pts.begin() + edit.point_offset;
+        pts_at = alpha_control_pts.erase(pts_at, pts_at + remove_pts.size());
+        alpha_control_pts.insert(pts_at, insert_pts.begin(), insert_pts.end());
+        auto modes_at = alpha_control_modes.begin() + edit.point_offset;
+        modes_at = alpha_control_modes.erase(modes_at, modes_at + remove_pts.size());
+        alpha_control_modes.insert(modes_at, insert_modes.begin(), insert_modes.end());
+        control_points_replaced = true;
+    }
+    if (edit.fields & StateEdit::RANGE) {
+        range = undo ? edit.old_range : edit.new_range;
+        NotifyChanged(CHANGED_RANGE);
+    }
+    if (edit.fields & StateEdit::OPACITY_SCALE) {
+        opacity_scale = undo ? edit.old_opacity_scale : edit.new_opacity_scale;
+        NotifyChanged(CHANGED_OPACITY_SCALE);
+    }
+    if (edit.fields & StateEdit::COLORMAP) {
+        selected_colormap = undo ? edit.old_colormap : edit.new_colormap;
+    }
+    if (edit.fields & StateEdit::STATE_COLORS) {
+        colormaps[state_colormap].colormap = undo ? edit.old_state_colors : edit.new_state_colors;
+    }
+
+    // Point edits only touch the opacities of the segments they changed
+    if (edit.fields &
+        (StateEdit::OPACITY_SCALE | StateEdit::COLORMAP | StateEdit::STATE_COLORS)) {
+        UpdateColormap();
+    } else if (edit.fields & StateEdit::POINTS) {
+        UpdateColormapOpacity();
+    }
+    PublishSnapshot();
+    SyncRecordedState();
+}
+
+void TransferFunctionEngine::PublishSnapshot()
+{
+    // Published with the held changes once they're reported
+    if (updates_held) {
+        return;
+    }
+    if (published_version == colormap_version && published_range.x == range.x &&
+        published_range.y == range.y) {
+        return;
+    }
+    ColormapSnapshot snapshot;
+    snapshot.rgba = current_colormap;
+    snapshot.range = range;
+    snapshot.version = colormap_version;
+    CountAllocation(snapshot.rgba.size());
+    snapshots.Publish(std::move(snapshot));
+    ++perf_counters.snapshots_published;
+    published_version = colormap_version;
+    published_range = range;
+}
+
+TransferFunctionEngine::SnapshotHandle TransferFunctionEngine::AcquireColormapSnapshot() const
+{
+    return snapshots.Acquire();
+}
+
+void TransferFunctionEngine::SetAsyncRebuild(bool enabled)
+{
+    if (enabled && !async_rebuild) {
+        async_rebuild.reset(new AsyncRebuild());
+    } else if (!enabled && async_rebuild) {
+        PollRebuild(true);
+        async_rebuild.reset();
+    }
+}
+
+bool TransferFunctionEngine::RebuildPending() const
+{
+    if (!async_rebuild) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(async_rebuild->mutex);
+    return async_rebuild->installed_generation != async_rebuild->generation.load();
+}
+
+void TransferFunctionEngine::RequestRebuild()
+{
+    // The table version only changes once the table is installed, so snapshots and
+    // caches never pair it with the old table
+    ++state_version;
+    // The worker gets its own copy of the colors and segments
+    CountAllocation(colormaps[selected_colormap].colormap.size());
+    AsyncRebuild *rebuild = async_rebuild.get();
+    const uint64_t generation = ++rebuild->generation;
+    rebuild->worker.Submit([rebuild,
+                            generation,
+                            table = colormaps[selected_colormap].colormap,
+                            segments = alpha_segments,
+                            scale = opacity_scale]() mutable {
+        if (rebuild->generation.load() != generation) {
+            return;
+        }
+        TFN_TRACE_ZONE("TransferFunctionEngine::AsyncRebuild");
+        sample_opacity(segments, scale, table.data() + 3, table.size() / 4, 4, 0, size_t(-1));
+
+        std::lock_guard<std::mutex> lock(rebuild->mutex);
+        rebuild->completed.swap(table);
+        rebuild->completed_generation = generation;
+        rebuild->completed_rebuild.notify_all();
+    });
+}
+
+bool TransferFunctionEngine::PollRebuild(bool wait)
+{
+    if (!async_rebuild) {
+        return false;
+    }
+    AsyncRebuild *rebuild = async_rebuild.get();
+    {
+        std::unique_lock<std::mutex> lock(rebuild->mutex);
+        if (wait) {
+            rebuild->completed_rebuild.wait(lock, [&]() {
+                return rebuild->completed_generation == rebuild->generation.load();
+            });
+        }
+        if (rebuild->completed_generation == rebuild->installed_generation) {
+            return false;
+        }
+        current_colormap.swap(rebuild->completed);
+        rebuild->installed_generation = rebuild->completed_generation;
+    }
+    ++perf_counters.table_rebuilds;
+    perf_counters.texels_recomputed += current_colormap.size() / 4;
+    ++colormap_version;
+    NotifyChanged(CHANGED_COLORMAP);
+    PublishSnapshot();
+    return true;
+}
+
+bool TransferFunctionEngine::Undo()
+{
+    // Changes not yet recorded become the edit being undone
+    RecordEdit();
+    if (!history.CanUndo()) {
+        return false;
+    }
+    ApplyEdit(history.Undo(), true);
+    return true;
+}
+
+bool TransferFunctionEngine::Redo()
+{
+    RecordEdit();
+    if (!history.CanRedo()) {
+        return false;
+    }
+    ApplyEdit(history.Redo(), false);
+    return true;
+}
+
+bool TransferFunctionEngine::CanUndo() const
+{
+    return history.CanUndo();
+}
+
+bool TransferFunctionEngine::CanRedo() const
+{
+    return history.CanRedo();
+}
+
+void TransferFunctionEngine::ClearHistory()
+{
+    history.Clear();
+    SyncRecordedState();
+}
+
+void TransferFunctionEngine::SetHistoryLimits(size_t max_entries, size_t max_bytes)
+{
+    history.SetLimits(max_entries, max_bytes);
+}
+
+void TransferFunctionEngine::SetInterpolationMode(InterpolationMode mode)
+{
+    alpha_control_modes.assign(alpha_control_pts.size(), mode);
+    UpdateColormapOpacity();
+    RecordEdit();
+}
+
+void TransferFunctionEngine::SetSegmentInterpolationMode(size_t segment, InterpolationMode mode)
+{
+    if (segment + 1 >= alpha_control_pts.size()) {
+        return;
+    }
+    alpha_control_modes[segment] = mode;
+    UpdateColormapOpacity();
+    RecordEdit();
+}
+
+InterpolationMode TransferFunctionEngine::GetSegmentInterpolationMode(size_t segment) const
+{
+    return segment < alpha_control_modes.size() ? alpha_control_modes[segment] : INTERP_LINEAR;
+}
+
+size_t TransferFunctionEngine::SimplifyOpacityCurve(float max_error)
+{
+    const size_t n = alpha_control_pts.size();
+    if (n <= 2) {
+        return 0;
+    }
+    std::vector<float> xs(n);
+    std::vector<float> ys(n);
+    for (size_t i = 0; i < n; ++i) {
+        xs[i] = alpha_control_pts[i].x;
+        ys[i] = alpha_control_pts[i].y;
+    }
+
+    const size_t npixels = current_colormap.size() / 4;
+    std::vector<uint8_t> original(npixels);
+    std::vector<uint8_t> simplified(npixels);
+    SampleOpacity(alpha_segments, original.data(), npixels, 1);
+
+    // The curve error bounds the table error of linear segments, but the table is
+    // quantized and curved segments change shape when their neighbors are removed, so
+    // verify the result and tighten the curve tolerance until it's within max_error
+    float curve_error = max_error / (255.f * std::max(opacity_scale, 1e-6f));
+    for (int attempt = 0; attempt < 8; ++attempt, curve_error *= 0.5f) {
+        const std::vector<size_t> kept = SimplifyCurve(xs.data(), ys.data(), n, curve_error);
+        std::vector<vec2f> pts;
+        std::vector<InterpolationMode> modes;
+        pts.reserve(kept.size());
+        modes.reserve(kept.size());
+        for (const auto &i : kept) {
+            pts.push_back(alpha_control_pts[i]);
+            modes.push_back(alpha_control_modes[i]);
+        }
+        CurveSegments segments;
+        ComputeOpacitySegments(pts, modes, segments);
+        SampleOpacity(segments, simplified.data(), npixels, 1);
+
+        bool within_error = true;
+        for (size_t i = 0; i < npixels && within_error; ++i) {
+            within_error = std::abs(int(original[i]) - int(simplified[i])) <= max_error;
+        }
+        if (within_error) {
+            alpha_control_pts.swap(pts);
+            alpha_control_modes.swap(modes);
+            control_points_replaced = true;
+            UpdateColormapOpacity();
+            RecordEdit();
+            return n - alpha_control_pts.size();
+        }
+    }
+    return 0;
+}
+
+void TransferFunctionEngine::LoadEmbeddedPreset(const uint8_t *buf,
+                                                  size_t size,
+                                                  const std::string &name)
+{
+    int w, h, n;
+    uint8_t *img_data = stbi_load_from_memory(buf, (int)size, &w, &h, &n, 4);
+    auto img = std::vector<uint8_t>(img_data, img_data + w * 1 * 4);
+    stbi_image_free(img_data);
+    colormaps.emplace_back(name, img, SRGB);
+    Colormap &cmap = colormaps.back();
+    for (size_t i = 0; i < cmap.colormap.size() / 4; ++i) {
+        for (size_t j = 0; j < 3; ++j) {
+            const float x = srgb_to_linear(cmap.colormap[i * 4 + j] / 255.f);
+            cmap.colormap[i * 4 + j] = static_cast<uint8_t>(clamp(x * 255.f, 0.f, 255.f));
+        }
+    }
+}
+
+}
@@ -0,0 +1,752 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "edit_history.h"
+#include "keyframe_track.h"
+#include "opacity_curve.h"
+#include "performance_counters.h"
+#include "pixel_format.h"
+#include "quantile_sketch.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "transfer_function.h"
+
+namespace ImTF {
+
+enum ColorSpace { LINEAR, SRGB };
+
+// When changes made while dragging in the UI are reported to downstream consumers,
+// through the changed flags and the published snapshots. The widget itself always shows
+// the latest state
+enum UpdatePolicy {
+    // Report every change right away, i.e. every frame while dragging
+    UPDATE_EVERY_FRAME,
+    // Report changes while dragging at most a given number of times per second
+    UPDATE_RATE_LIMITED,
+    // Report the changes made while dragging once the drag is released
+    UPDATE_ON_RELEASE
+};
+
+struct Colormap {
+    std::string name;
+    // An RGBA8 1D image
+    std::vector<uint8_t> colormap;
+    ColorSpace color_space;
+
+    Colormap(const std::string &name,
+             const std::vector<uint8_t> &img,
+             const ColorSpace color_space);
+};
+
+// A 2D point or vector. Converts implicitly from and to any type with x and y members
+// which can be built from two floats, e.g. ImVec2, without depending on ImGui
+struct vec2f {
+    float x, y;
+
+    vec2f(float c = 0.f);
+    vec2f(float x, float y);
+
+    template <typename V, typename = decltype(V::x), typename = decltype(V::y)>
+    vec2f(const V &v) : x(v.x), y(v.y)
+    {
+    }
+
+    float length() const;
+
+    vec2f operator+(const vec2f &b) const;
+    vec2f operator-(const vec2f &b) const;
+    vec2f operator/(const vec2f &b) const;
+    vec2f operator*(const vec2f &b) const;
+
+    template <typename V, typename = decltype(V{0.f, 0.f}), typename = decltype(V::x)>
+    operator V() const
+    {
+        return V{x, y};
+    }
+};
+
+// An image the colormap bar is overlaid on by the multi-frame overlay functions.
+// row_stride is the distance between rows in bytes, or 0 if the rows are tightly packed
+template <typename Format>
+struct OverlayFrame {
+    typename Format::channel_type *image = nullptr;
+    int width = 0;
+    int height = 0;
+    size_t row_stride = 0;
+};
+
+// An immutable copy of the RGBA8 colormap and its range published for render threads
+struct ColormapSnapshot {
+    std::vector<uint8_t> rgba;
+    vec2f range;
+    // The colormap version the table was copied from (see ColormapVersion)
+    uint64_t version = 0;
+};
+
+// The transfer function without any UI: the colormap presets, the opacity curve and the
+// RGBA8 table built from them, undo history, serialization, classification and the
+// colormap bar overlay. It doesn't use OpenGL or ImGui, so services which only evaluate
+// transfer functions can link it alone (the tfn_core library). TransferFunctionWidget
+// adds the ImGui editor and the OpenGL textures on top of it
+class TransferFunctionEngine {
+    // Classifies its channels block by block with ClassifyValues
+    friend class MultiChannelTransferFunction;
+
+protected:
+    std::vector<Colormap> colormaps;
+    size_t selected_colormap = 0;
+    std::vector<uint8_t> current_colormap;
+
+    std::vector<vec2f> alpha_control_pts = {vec2f(0.f), vec2f(1.f)};
+    // The interpolation mode of the segment starting at each control point, kept in
+    // the same order as the points. The last one is unused
+    std::vector<InterpolationMode> alpha_control_modes = {INTERP_LINEAR, INTERP_LINEAR};
+    // The curve's segment coefficients, recomputed on each edit
+    CurveSegments alpha_segments;
+    // Set when the control points are replaced as a whole (e.g. by undo or SetState),
+    // for the UI to drop its references to them
+    bool control_points_replaced = false;
+
+    // An undoable edit of the state: the control points replaced starting at
+    // point_offset, and the before and after values of the other fields changed
+    struct StateEdit {
+        enum Fields {
+            POINTS = 1,
+            RANGE = 2,
+            OPACITY_SCALE = 4,
+            COLORMAP = 8,
+            STATE_COLORS = 16
+        };
+        uint32_t fields = 0;
+        size_t point_offset = 0;
+        std::vector<vec2f> old_pts, new_pts;
+        std::vector<InterpolationMode> old_modes, new_modes;
+        vec2f old_range, new_range;
+        float old_opacity_scale = 1.f;
+        float new_opacity_scale = 1.f;
+        size_t old_colormap = 0;
+        size_t new_colormap = 0;
+        // The colors of the state_colormap, which SetState replaces in place
+        std::vector<uint8_t> old_state_colors, new_state_colors;
+
+        size_t Bytes() const;
+    };
+    EditHistory<StateEdit> history;
+    // The state as of the last recorded edit, which new edits are diffed against
+    std::vector<vec2f> recorded_pts;
+    std::vector<InterpolationMode> recorded_modes;
+    vec2f recorded_range;
+    float recorded_opacity_scale = 1.f;
+    size_t recorded_colormap = 0;
+    std::vector<uint8_t> recorded_state_colors;
+    uint64_t recorded_version = 0;
+
+    // The colormap added by SetState for colors not matching any colormap, reused by
+    // later states
+    size_t state_colormap = -1;
+
+    float opacity_scale = 1.f;
+    vec2f range = vec2f(0.f, 1.f);
+
+    bool colormap_changed = true;
+    bool opacity_scale_changed = true;
+    bool range_changed = true;
+
+    // The changes held back from downstream consumers by the update policy, reported
+    // when the drag is released or the next rate limited update is due
+    enum ChangeFlags { CHANGED_COLORMAP = 1, CHANGED_OPACITY_SCALE = 2, CHANGED_RANGE = 4 };
+    UpdatePolicy update_policy = UPDATE_EVERY_FRAME;
+    float update_rate = 30.f;
+    bool updates_held = false;
+    uint32_t held_changes = 0;
+    // Steady clock time in nanoseconds changes were last reported while rate limited
+    uint64_t last_update_time = 0;
+
+    // Incremented every time current_colormap is rebuilt, used to key caches
+    // derived from the colormap. Async rebuilds only increment it once their table
+    // is installed
+    uint64_t colormap_version = 0;
+    // Incremented by every change to the state the table is built from, including
+    // async rebuild requests, so edits are recorded before their table is installed
+    uint64_t state_version = 0;
+
+    // The colormap bar, ticks and labels drawn by OverlayColormapBar pre-rendered
+    // into a sprite, which is reused until any of its key parameters change
+    struct ColorbarSprite {
+        // A run of covered pixels within a row of the sprite
+        struct Span {
+            int x, length;
+            // Opaque runs are copied, others are blended by their coverage
+            bool opaque;
+        };
+
+        // Offset of the sprite's top-left corner from the bar's top-left corner
+        int x = 0, y = 0;
+        int width = 0, height = 0;
+        std::vector<uint32_t> pixels;
+        std::vector<uint8_t> coverage;
+        // The covered runs of row i are spans[rows[i]] to spans[rows[i + 1]]
+        std::vector<Span> spans;
+        std::vector<size_t> rows;
+
+        uint64_t colormap_version = 0;
+        float scale = 0.f;
+        float value_min = 0.f;
+        float value_max = 0.f;
+        bool flip_vertically = false;
+        bool antialias = false;
+    };
+    std::shared_ptr<const ColorbarSprite> colorbar_sprite;
+
+    // The workers compositing OverlayColormapBarStream's frames, kept between calls
+    // so per-frame overlays don't start and join threads every time
+    std::unique_ptr<ThreadPool> overlay_pool;
+
+    // The colormap and range published to render threads, republished whenever
+    // either changes
+    SnapshotPublisher<ColormapSnapshot> snapshots;
+    uint64_t published_version = -1;
+    vec2f published_range = vec2f(-1.f, -1.f);
+
+    // Counters of the work done, updated by const functions too
+    mutable PerformanceCounters perf_counters;
+
+    // The async table rebuild worker, null when rebuilding synchronously
+    struct AsyncRebuild;
+    std::unique_ptr<AsyncRebuild> async_rebuild;
+
+    // Percentiles of the data AutoRange sets the range to
+    vec2f auto_range_percentiles = vec2f(1.f, 99.f);
+
+public:
+    using SnapshotHandle = SnapshotPublisher<ColormapSnapshot>::Handle;
+
+    // A number label drawn by DrawBitmapNumbers, x and y are the top-left corner
+    struct BitmapLabel {
+        float value;
+        int x, y;
+    };
+
+    // Loads the embedded colormap presets and starts with a linear opacity ramp
+    TransferFunctionEngine();
+
+    // Engines can't be copied, see GetState and SetState to copy the transfer function.
+    // Moving transfers the tables, history and rebuild worker without copying them, but
+    // isn't thread-safe: render threads must not be acquiring snapshots of either engine.
+    // The moved-from engine can only be destroyed or assigned to
+    TransferFunctionEngine(const TransferFunctionEngine &) = delete;
+    TransferFunctionEngine &operator=(const TransferFunctionEngine &) = delete;
+    TransferFunctionEngine(TransferFunctionEngine &&e) noexcept;
+    TransferFunctionEngine &operator=(TransferFunctionEngine &&e) noexcept;
+
+    ~TransferFunctionEngine();
+
+    // Add a colormap preset. The image should be a 1D RGBA8 image, if the image
+    // is provided in sRGBA colorspace it will be linearized
+    void AddColormap(const Colormap &map);
+
+    // Returns true if the colormap, opacity scale or range changed since they were
+    // last read
+    bool Changed() const;
+
+    // Returns true if the colormap was updated since the last
+    // call to GetColormap
+    bool ColorMapChanged() const;
+
+    // Returns true if the opacity scale was updated since the last
+    // call to GetOpacityScale
+    bool OpacityScaleChanged() const;
+
+    // Returns true if the range was updated since the last
+    // call to GetRange
+    bool RangeChanged() const;
+
+    // Get back the RGBA8 color data for the transfer function
+    std::vector<uint8_t> GetColormap();
+
+    // Read the current RGBA8 table without copying it or clearing the changed flag
+    const std::vector<uint8_t> &ColormapTable() const;
+
+    // Incremented each time the RGBA8 table is rebuilt
+    uint64_t ColormapVersion() const;
+
+    // Get back the RGBA32F color data for the transfer function
+    std::vector<float> GetColormapf();
+
+    // Get back the RGBA32F color data for the transfer function
+    // as separate color and opacity vectors
+    void GetColormapf(std::vector<float> &color, std::vector<float> &opacity);
+
+    // Classify count values into RGBA8 colors with the 1D transfer function.
+    // dataRange is the full data range, as for DrawRuler, values outside the part
+    // covered by the transfer function's range clamp to its ends. The values are
+    // read with the given stride in elements and the colors written rgba_stride
+    // bytes apart. Like GetColormap, a completed async rebuild is installed first, a
+    // rebuild still running isn't waited for (see PollRebuild)
+    void Classify(const float *values,
+                  size_t count,
+                  vec2f dataRange,
+                  uint8_t *rgba,
+                  size_t stride = 1,
+                  size_t rgba_stride = 4);
+
+    // Export the table into a fixed size transfer function, resampled to its size if
+    // they differ, with its range set to the data values the table covers within
+    // dataRange as for Classify. A completed async rebuild is installed first
+    template <size_t N, typename Format, LookupFilter Interp>
+    void Export(TransferFunction<N, Format, Interp> &tfn, vec2f dataRange);
+
+    // Set the lower and upper percentiles (in [0, 100]) the automatic range selects
+    void SetAutoRangePercentiles(float lower, float upper);
+
+    // Set the range to the auto range percentiles of the data summarized by the sketch,
+    // relative to the data range. Returns false if the sketch is empty
+    bool AutoRange(const QuantileSketch &sketch, vec2f dataRange);
+
+    // Remove opacity control points while keeping every opacity in the colormap within
+    // max_error (in 8-bit table units) of its current value, to make dense imported
+    // curves editable and cheaper to draw and update. Returns the number of points removed
+    size_t SimplifyOpacityCurve(float max_error = 1.f);
+
+    // Set how the opacity curve is interpolated between all the control points, or
+    // only from control point segment to the next one
+    void SetInterpolationMode(InterpolationMode mode);
+    void SetSegmentInterpolationMode(size_t segment, InterpolationMode mode);
+
+    InterpolationMode GetSegmentInterpolationMode(size_t segment) const;
+
+    // Get the state of the transfer function, e.g. to add as a keyframe to a
+    // KeyframeTrack (see keyframe_track.h)
+    TransferFunctionState GetState() const;
+
+    // Set the state of the transfer function. If the colors don't match any of the
+    // colormaps they're shown as a "Keyframe" colormap
+    void SetState(const TransferFunctionState &state);
+
+    // Undo or redo the last edit made through the UI or API, returns false if there's
+    // nothing to undo or redo. Continuous edits like dragging a point are undone as one
+    bool Undo();
+    bool Redo();
+
+    bool CanUndo() const;
+    bool CanRedo() const;
+
+    void ClearHistory();
+
+    // Limit the undo history to max_entries edits taking at most max_bytes, dropping
+    // the oldest edits past either limit (defaults are 256 edits and 1MB)
+    void SetHistoryLimits(size_t max_entries, size_t max_bytes);
+
+    // Get the latest published colormap and range. Can be called from any thread
+    // (e.g. a render thread) without waiting on the UI thread, the snapshot stays
+    // valid and unchanged for as long as the handle is held
+    SnapshotHandle AcquireColormapSnapshot() const;
+
+    // Rebuild the table on a worker thread instead of in the edit, for large colormaps
+    // whose rebuild would drop UI frames. Only the latest of the rebuilds requested
+    // while the worker is busy is run, and the last completed table is used until the
+    // next one is installed by DrawColorMap, GetColormap or PollRebuild
+    void SetAsyncRebuild(bool enabled);
+
+    // Install the latest completed table, returns true if the table changed. If wait is
+    // set this blocks until the latest requested rebuild is done
+    bool PollRebuild(bool wait = false);
+
+    // Returns true if the table doesn't reflect the latest edit yet
+    bool RebuildPending() const;
+
+    // Set the opacity scale in [0, 1], the table's opacities are multiplied by it
+    void SetOpacityScale(float scale);
+
+    // Set how often changes made while dragging are reported downstream, rate is the
+    // number of updates per second for UPDATE_RATE_LIMITED. Changes made through the API
+    // are always reported right away
+    void SetUpdatePolicy(UpdatePolicy policy, float rate = 30.f);
+
+    UpdatePolicy GetUpdatePolicy() const;
+
+    // True while changes are held back from downstream consumers by the update policy
+    bool UpdatesHeld() const;
+
+    // Counters of the table rebuilds, texture uploads, allocations and time spent
+    // updating and drawing since it was created or the counters were reset
+    const PerformanceCounters &GetPerformanceCounters() const;
+
+    void ResetPerformanceCounters();
+
+    // Get back the opacity scale
+    float GetOpacityScale();
+
+    // Get back the range
+    vec2f GetRange();
+
+    // Overlays the colormap bar on the image, the labels can optionally be antialiased
+    void OverlayColormapBar(std::vector<uint32_t>& image, int imageWidth, int imageHeight,
+                           vec2f pos, vec2f dataRange, float scale, bool flip_vertically = false,
+                           bool antialias_labels = false);
+
+    // Overlays the colormap bar on an image in any pixel format (see pixel_format.h),
+    // writing directly into the caller's memory. row_stride is the distance between
+    // rows in bytes, or 0 if the rows are tightly packed
+    template <typename Format>
+    void OverlayColormapBar(typename Format::channel_type *image,
+                            int imageWidth,
+                            int imageHeight,
+                            size_t row_stride,
+                            vec2f pos,
+                            vec2f dataRange,
+                            float scale,
+                            bool flip_vertically = false,
+                            OverlayMode mode = OVERLAY_OVERWRITE,
+                            bool antialias_labels = false);
+
+    // Overlays the colormap bar on many frames in parallel on num_threads threads (0 for
+    // one per hardware thread). All frames share one pre-rendered bar, and the threads
+    // are kept for later calls with the same num_threads
+    template <typename Format>
+    void OverlayColormapBarFrames(const std::vector<OverlayFrame<Format>> &frames,
+                                  vec2f pos,
+                                  vec2f dataRange,
+                                  float scale,
+                                  bool flip_vertically = false,
+                                  OverlayMode mode = OVERLAY_OVERWRITE,
+                                  bool antialias_labels = false,
+                                  unsigned num_threads = 0);
+
+    // Overlays the colormap bar on a stream of frames in parallel. next_frame is called
+    // on the calling thread to fetch frame i until it returns false, and may update the
+    // widget between frames (e.g. to load the next keyframe), the bar is only re-rendered
+    // when the colormap or its labels change. frame_done is called on the calling thread
+    // with each finished frame in order. At most max_in_flight frames are held at once
+    // (0 for twice the number of threads), bounding memory use
+    template <typename Format>
+    void OverlayColormapBarStream(
+        const std::function<bool(size_t i, OverlayFrame<Format> &frame)> &next_frame,
+        const std::function<void(size_t i, const OverlayFrame<Format> &frame)> &frame_done,
+        vec2f pos,
+        vec2f dataRange,
+        float scale,
+        bool flip_vertically = false,
+        OverlayMode mode = OVERLAY_OVERWRITE,
+        bool antialias_labels = false,
+        size_t max_in_flight = 0,
+        unsigned num_threads = 0);
+
+    // Draws number labels on the image with the bitmap font used by the colormap bar.
+    // Glyphs are cached pre-scaled for each scale, so any number of labels can be drawn
+    // in one call without re-rasterizing the font
+    static void DrawBitmapNumbers(std::vector<uint32_t> &image,
+                                  int imageWidth,
+                                  int imageHeight,
+                                  const std::vector<BitmapLabel> &labels,
+                                  float scale,
+                                  bool flip_vertically = false,
+                                  bool antialias = false,
+                                  uint32_t color = 0xFFFFFFFF);
+
+    // Load a state from a file
+    bool LoadState(const std::string &filepath);
+
+    // Save a state to a file
+    bool SaveState(const std::string &filepath);
+
+protected:
+    void UpdateColormap();
+
+    // Update only the opacities of the colormap covered by the curve segments which
+    // changed since it was last updated. Only valid when the control points changed
+    void UpdateColormapOpacity();
+
+    // Add an edit to the history for the changes since the last recorded one. While
+    // in_progress is set (e.g. a point is being dragged) the changes are held back
+    // and recorded together once it's done
+    void RecordEdit(bool in_progress = false);
+
+    // Set the changed flags, or hold the changes back while the update policy holds
+    // updates. changes is a combination of ChangeFlags
+    void NotifyChanged(uint32_t changes);
+
+    // Decide whether the update policy holds back the changes made while in_progress is
+    // set, and report the held changes if it doesn't
+    void HoldUpdates(bool in_progress);
+
+    // Take the current state as the one the next edit is diffed against
+    void SyncRecordedState();
+
+    // Revert (undo) or reapply an edit
+    void ApplyEdit(const StateEdit &edit, bool undo);
+
+    // Publish the colormap and range to render threads if either changed
+    void PublishSnapshot();
+
+    // Queue a rebuild of the table from the current state on the async rebuild worker
+    void RequestRebuild();
+
+    // Count a heap allocation made by the transfer function in the performance counters
+    void CountAllocation(size_t bytes) const;
+
+    // Sort the control points by x, keeping their interpolation modes with them
+    void SortControlPoints();
+
+    // Compute the segments of the opacity curve through the points
+    static void ComputeOpacitySegments(const std::vector<vec2f> &pts,
+                                       const std::vector<InterpolationMode> &modes,
+                                       CurveSegments &segments);
+
+    // Sample the opacity curve, scaled by the opacity scale, into the npixels 8-bit
+    // alpha values written stride bytes apart, or only those in [begin, end)
+    void SampleOpacity(const CurveSegments &segments,
+                       uint8_t *alpha,
+                       size_t npixels,
+                       size_t stride,
+                       size_t begin = 0,
+                       size_t end = size_t(-1)) const;
+
+    // Classify without a trace zone or installing completed async rebuilds, for
+    // classifying in many small blocks
+    void ClassifyValues(const float *values,
+                        size_t count,
+                        vec2f dataRange,
+                        uint8_t *rgba,
+                        size_t stride,
+                        size_t rgba_stride) const;
+
+    void LoadEmbeddedPresets();
+
+    void LoadEmbeddedPreset(const uint8_t *buf, size_t size, const std::string &name);
+
+    // Find where the colormap bar goes in the image and get its sprite, rebuilding it
+    // if needed. Returns null if the bar is outside the image
+    std::shared_ptr<const ColorbarSprite> PrepareColorbarSprite(int imageWidth,
+                                                int imageHeight,
+                                                vec2f pos,
+                                                vec2f dataRange,
+                                                float scale,
+                                                bool flip_vertically,
+                                                bool antialias,
+                                                int &originX,
+                                                int &originY);
+
+    // Write the sprite into the image with its top-left corner at originX, originY
+    template <typename Format>
+    static void CompositeColorbarSprite(const ColorbarSprite &sprite,
+                                        typename Format::channel_type *image,
+                                        int imageWidth,
+                                        int imageHeight,
+                                        size_t row_stride,
+                                        int originX,
+                                        int originY,
+                                        OverlayMode mode);
+
+    // The overlay worker pool with num_threads threads (0 for one per hardware thread),
+    // replaced only when a different number of threads is asked for
+    ThreadPool &OverlayPool(unsigned num_threads);
+
+    // Render the colormap bar, ticks and labels for OverlayColormapBar into a sprite
+    std::shared_ptr<const ColorbarSprite> BuildColorbarSprite(float value_min,
+                                                              float value_max,
+                                                              float scale,
+                                                              bool flip_vertically,
+                                                              bool antialias) const;
+};
+
+template <size_t N, typename Format, LookupFilter Interp>
+void TransferFunctionEngine::Export(TransferFunction<N, Format, Interp> &tfn,
+                                    vec2f dataRange)
+{
+    PollRebuild();
+    const float dataSpan = dataRange.y - dataRange.x;
+    tfn.SetTable(current_colormap.data(), current_colormap.size() / 4);
+    tfn.SetRange(dataRange.x + range.x * dataSpan, dataRange.x + range.y * dataSpan);
+}
+
+template <typename Format>
+void TransferFunctionEngine::OverlayColormapBar(typename Format::channel_type *image,
+                                                int imageWidth,
+                                                int imageHeight,
+                                                size_t row_stride,
+                                                vec2f pos,
+                                                vec2f dataRange,
+                                                float scale,
+                                                bool flip_vertically,
+                                                OverlayMode mode,
+                                                bool antialias_labels)
+{
+    TFN_TRACE_ZONE("TransferFunctionEngine::OverlayColormapBar");
+    int originX = 0;
+    int originY = 0;
+    auto sprite = PrepareColorbarSprite(imageWidth,
+                                        imageHeight,
+                                        pos,
+                                        dataRange,
+                                        scale,
+                                        flip_vertically,
+                                        antialias_labels,
+                                        originX,
+                                        originY);
+    if (sprite) {
+        CompositeColorbarSprite<Format>(
+            *sprite, image, imageWidth, imageHeight, row_stride, originX, originY, mode);
+    }
+}
+
+template <typename Format>
+void TransferFunctionEngine::OverlayColormapBarFrames(const std::vector<OverlayFrame<Format>> &frames,
+                                                      vec2f pos,
+                                                      vec2f dataRange,
+                                                      float scale,
+                                                      bool flip_vertically,
+                                                      OverlayMode mode,
+                                                      bool antialias_labels,
+                                                      unsigned num_threads)
+{
+    // The frames are all in memory already, so there's no need to bound how many are
+    // in flight
+    OverlayColormapBarStream<Format>(
+        [&](size_t i, OverlayFrame<Format> &frame) {
+            if (i >= frames.size()) {
+                return false;
+            }
+            frame = frames[i];
+            return true;
+        },
+        [](size_t, const OverlayFrame<Format> &) {},
+        pos,
+        dataRange,
+        scale,
+        flip_vertically,
+        mode,
+        antialias_labels,
+        std::max(frames.size(), size_t(1)),
+        num_threads);
+}
+
+template <typename Format>
+void TransferFunctionEngine::OverlayColormapBarStream(
+    const std::function<bool(size_t i, OverlayFrame<Format> &frame)> &next_frame,
+    const std::function<void(size_t i, const OverlayFrame<Format> &frame)> &frame_done,
+    vec2f pos,
+    vec2f dataRange,
+    float scale,
+    bool flip_vertically,
+    OverlayMode mode,
+    bool antialias_labels,
+    size_t max_in_flight,
+    unsigned num_threads)
+{
+    TFN_TRACE_ZONE("TransferFunctionEngine::OverlayColormapBarStream");
+    struct InFlight {
+        size_t index;
+        OverlayFrame<Format> frame;
+        std::future<void> done;
+    };
+
+    ThreadPool &pool = OverlayPool(num_threads);
+    if (max_in_flight == 0) {
+        max_in_flight = 2 * pool.Size();
+    }
+
+    std::deque<InFlight> in_flight;
+    auto finish_oldest = [&]() {
+        InFlight &oldest = in_flight.front();
+        if (oldest.done.valid()) {
+            oldest.done.get();
+        }
+        frame_done(oldest.index, oldest.frame);
+        in_flight.pop_front();
+    };
+
+    for (size_t i = 0;; ++i) {
+        if (in_flight.size() >= max_in_flight) {
+            finish_oldest();
+        }
+        OverlayFrame<Format> frame;
+        if (!next_frame(i, frame)) {
+            break;
+        }
+
+        // The sprite is shared with the workers, so rebuilding it for a later frame
+        // doesn't affect the ones still being composited
+        int originX = 0;
+        int originY = 0;
+        auto sprite = PrepareColorbarSprite(frame.width,
+                                            frame.height,
+                                            pos,
+                                            dataRange,
+                                            scale,
+                                            flip_vertically,
+                                            antialias_labels,
+                                            originX,
+                                            originY);
+        InFlight job = {i, frame, std::future<void>()};
+        if (sprite) {
+            job.done = pool.Submit([sprite, frame, originX, originY, mode]() {
+                TFN_TRACE_ZONE("TransferFunctionEngine::CompositeColorbarSprite");
+                CompositeColorbarSprite<Format>(*sprite,
+                                                frame.image,
+                                                frame.width,
+                                                frame.height,
+                                                frame.row_stride,
+                                                originX,
+                                                originY,
+                                                mode);
+            });
+        }
+        in_flight.push_back(std::move(job));
+    }
+    while (!in_flight.empty()) {
+        finish_oldest();
+    }
+}
+
+template <typename Format>
+void TransferFunctionEngine::CompositeColorbarSprite(const ColorbarSprite &sprite,
+                                                     typename Format::channel_type *image,
+                                                     int imageWidth,
+                                                     int imageHeight,
+                                                     size_t row_stride,
+                                                     int originX,
+                                                     int originY,
+                                                     OverlayMode mode)
+{
+    if (row_stride == 0) {
+        row_stride = imageWidth * Format::pixel_size;
+    }
+
+    // Composite the sprite row by row, writing each covered run clipped to the image
+    const bool alpha_blend = mode == OVERLAY_ALPHA_BLEND;
+    const int rowBegin = std::max(0, -originY);
+    const int rowEnd = std::min(sprite.height, imageHeight - originY);
+    for (int row = rowBegin; row < rowEnd; ++row) {
+        auto *dst = reinterpret_cast<typename Format::channel_type *>(
+            reinterpret_cast<uint8_t *>(image) + (originY + row) * row_stride);
+        const size_t rowOffset = static_cast<size_t>(row) * sprite.width;
+        const uint32_t *src = sprite.pixels.data() + rowOffset;
+        const uint8_t *coverage = sprite.coverage.data() + rowOffset;
+        for (size_t s = sprite.rows[row]; s < sprite.rows[row + 1]; ++s) {
+            const ColorbarSprite::Span &span = sprite.spans[s];
+            const int x0 = std::max(span.x, -originX);
+            const int x1 = std::min(span.x + span.length, imageWidth - originX);
+            if (x0 >= x1) {
+                continue;
+            }
+            if (span.opaque && !alpha_blend) {
+                Format::StoreRow(dst + (originX + x0) * Format::channels, src + x0, x1 - x0);
+            } else {
+                Format::BlendRow(dst + (originX + x0) * Format::channels,
+                                 src + x0,
+                                 coverage + x0,
+                                 x1 - x0,
+                                 alpha_blend);
+            }
+        }
+    }
+}
+}
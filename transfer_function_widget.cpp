@@ -1,15 +1,11 @@
 #include "transfer_function_widget.h"
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstdio>
 #include <iostream>
-#include <fstream>
-#include "embedded_colormaps.h"
-
-#ifndef TFN_WIDGET_NO_STB_IMAGE_IMPL
-#define STB_IMAGE_IMPLEMENTATION
-#endif
-
-#include "stb_image.h"
+#include <mutex>
+#include <type_traits>
 
 namespace ImTF {
 
@@ -25,124 +21,72 @@ inline T clamp(T x, T min, T max)
     return x;
 }
 
-inline float srgb_to_linear(const float x)
-{
-    if (x <= 0.04045f) {
-        return x / 12.92f;
-    } else {
-        return std::pow((x + 0.055f) / 1.055f, 2.4f);
-    }
-}
-
-Colormap::Colormap(const std::string &name,
-                   const std::vector<uint8_t> &img,
-                   const ColorSpace color_space)
-    : name(name), colormap(img), color_space(color_space)
-{
-}
-
-TransferFunctionWidget::vec2f::vec2f(float c) : x(c), y(c) {}
+namespace {
 
-TransferFunctionWidget::vec2f::vec2f(float x, float y) : x(x), y(y) {}
-
-TransferFunctionWidget::vec2f::vec2f(const ImVec2 &v) : x(v.x), y(v.y) {}
-
-float TransferFunctionWidget::vec2f::length() const
-{
-    return std::sqrt(x * x + y * y);
-}
-
-TransferFunctionWidget::vec2f TransferFunctionWidget::vec2f::operator+(
-    const TransferFunctionWidget::vec2f &b) const
-{
-    return vec2f(x + b.x, y + b.y);
-}
-
-TransferFunctionWidget::vec2f TransferFunctionWidget::vec2f::operator-(
-    const TransferFunctionWidget::vec2f &b) const
-{
-    return vec2f(x - b.x, y - b.y);
-}
+// Set once the GL functions are loaded, by the first successful LoadOpenGLFunctions
+// or by the host. Failed loads are retried, e.g. if no context was current yet
+std::atomic<bool> gl_functions_loaded(false);
+std::mutex gl_load_mutex;
 
-TransferFunctionWidget::vec2f TransferFunctionWidget::vec2f::operator/(
-    const TransferFunctionWidget::vec2f &b) const
-{
-    return vec2f(x / b.x, y / b.y);
 }
 
-TransferFunctionWidget::vec2f TransferFunctionWidget::vec2f::operator*(
-    const TransferFunctionWidget::vec2f &b) const
+bool LoadOpenGLFunctions()
 {
-    return vec2f(x * b.x, y * b.y);
+    if (gl_functions_loaded.load(std::memory_order_acquire)) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(gl_load_mutex);
+    if (!gl_functions_loaded.load(std::memory_order_relaxed) &&
+        ogl_LoadFunctions() != ogl_LOAD_FAILED) {
+        gl_functions_loaded.store(true, std::memory_order_release);
+    }
+    return gl_functions_loaded.load(std::memory_order_relaxed);
 }
 
-TransferFunctionWidget::vec2f::operator ImVec2() const
+void SetOpenGLFunctionsLoaded()
 {
-    return ImVec2(x, y);
+    gl_functions_loaded.store(true, std::memory_order_release);
 }
 
 TransferFunctionWidget::TransferFunctionWidget(bool noGui)
     :noGui(noGui)
 {
-    if (!noGui && ogl_LoadFunctions() == ogl_LOAD_FAILED)
+    if (!noGui && !LoadOpenGLFunctions())
     {
         std::cerr << "Failed to initialize OpenGL\n";
         return;
     }
-    // Load up the embedded colormaps as the default options
-    LoadEmbeddedPreset(paraview_cool_warm, sizeof(paraview_cool_warm), "ParaView Cool Warm");
-    LoadEmbeddedPreset(rainbow, sizeof(rainbow), "Rainbow");
-    LoadEmbeddedPreset(reds, sizeof(reds), "Reds");
-    LoadEmbeddedPreset(greens, sizeof(greens), "Greens");
-    LoadEmbeddedPreset(blues, sizeof(blues), "Blues");
-    LoadEmbeddedPreset(matplotlib_plasma, sizeof(matplotlib_plasma), "Matplotlib Plasma");
-    LoadEmbeddedPreset(matplotlib_virdis, sizeof(matplotlib_virdis), "Matplotlib Virdis");
-    LoadEmbeddedPreset(matplotlib_BrBg, sizeof(matplotlib_BrBg), "Matplotlib BrBg");
-    LoadEmbeddedPreset(matplotlib_terrain, sizeof(matplotlib_terrain), "Matplotlib Terrain");
-    LoadEmbeddedPreset(tacc_outlier, sizeof(tacc_outlier), "TACC Outlier");
-    LoadEmbeddedPreset(
-        samsel_linear_green, sizeof(samsel_linear_green), "Samsel Linear Green");
-    LoadEmbeddedPreset(
-        samsel_linear_ygb_1211g, sizeof(samsel_linear_ygb_1211g), "Samsel Linear YGB 1211G");
-    LoadEmbeddedPreset(cool_warm_extended, sizeof(cool_warm_extended), "Cool Warm Extended");
-    LoadEmbeddedPreset(blackbody, sizeof(blackbody), "Black Body");
-    LoadEmbeddedPreset(jet, sizeof(jet), "Jet");
-    LoadEmbeddedPreset(blue_gold, sizeof(blue_gold), "Blue Gold");
-    LoadEmbeddedPreset(ice_fire, sizeof(ice_fire), "Ice Fire");
-    LoadEmbeddedPreset(nic_edge, sizeof(nic_edge), "nic Edge");
-    LoadEmbeddedPreset(cube_helix, sizeof(cube_helix), "Cube Helix");
-    LoadEmbeddedPreset(linear_grayscale, sizeof(linear_grayscale), "Linear Grayscale");
-    LoadEmbeddedPreset(flat_red, sizeof(flat_red), "flat red");
-    LoadEmbeddedPreset(flat_green, sizeof(flat_green), "flat green");
-    LoadEmbeddedPreset(flat_blue, sizeof(flat_blue), "flat blue");
-
-    // Initialize the colormap alpha channel w/ a linear ramp
-    UpdateColormap();
 }
 
-void TransferFunctionWidget::AddColormap(const Colormap &map)
-{
-    colormaps.push_back(map);
-
-    if (colormaps.back().color_space == SRGB) {
-        Colormap &cmap = colormaps.back();
-        cmap.color_space = LINEAR;
-        for (size_t i = 0; i < cmap.colormap.size() / 4; ++i) {
-            for (size_t j = 0; j < 3; ++j) {
-                const float x = srgb_to_linear(cmap.colormap[i * 4 + j] / 255.f);
-                cmap.colormap[i * 4 + j] = static_cast<uint8_t>(clamp(x * 255.f, 0.f, 255.f));
-            }
-        }
-    }
-}
+TransferFunctionWidget::TransferFunctionWidget(TransferFunctionWidget &&) noexcept = default;
+
+TransferFunctionWidget &TransferFunctionWidget::operator=(TransferFunctionWidget &&) noexcept =
+    default;
+
+TransferFunctionWidget::~TransferFunctionWidget() = default;
+
+// The destructor is user-declared, which suppresses the implicit moves, so make sure
+// the defaulted ones above stay declared
+static_assert(std::is_nothrow_move_constructible<TransferFunctionWidget>::value &&
+                  std::is_nothrow_move_assignable<TransferFunctionWidget>::value,
+              "TransferFunctionWidget must stay movable");
 
 void TransferFunctionWidget::DrawColorMap(bool show_help)
 {
-    if(noGui)
+    if(noGui && !headless)
     {
         std::cerr << "TransferFunctionWidget::DrawColorMap() called with noGui set to true\n";
         return;
     }
+    ScopedTimer timer(perf_counters.draw_colormap);
+    if (mode_2d) {
+        DrawColorMap2D(show_help);
+        return;
+    }
+    // Edits are recorded once the item changing them is released, so a drag is
+    // undone as one edit
+    RecordEdit(editing != 0);
+    PollRebuild();
     UpdateGPUImage();
 
     const ImGuiIO &io = ImGui::GetIO();
@@ -152,7 +96,8 @@ void TransferFunctionWidget::DrawColorMap(bool show_help)
         ImGui::Text("Transfer Function");
         ImGui::TextWrapped(
             "Left click to add a point, right click remove. "
-            "Left click + drag to move points.");
+            "Left click + drag to move points. "
+            "Middle click to change how a segment is interpolated.");
     }
 
     if (ImGui::BeginCombo("Colormap", colormaps[selected_colormap].name.c_str())) {
@@ -170,10 +115,47 @@ void TransferFunctionWidget::DrawColorMap(bool show_help)
         alpha_control_pts.clear();
         alpha_control_pts.push_back(vec2f(0.f, 0.f));
         alpha_control_pts.push_back(vec2f(1.f, 1.f));
+        alpha_control_modes.assign(2, INTERP_LINEAR);
         selected_colormap = 0;
         opacity_scale = 1.f;
         UpdateColormap();
     }
+    ImGui::SameLine();
+    // Drop the points not needed to keep the colormap within one opacity level
+    if (ImGui::Button("Simplify")) {
+        SimplifyOpacityCurve(1.f);
+    }
+    ImGui::SameLine();
+    ImGui::BeginDisabled(!CanUndo());
+    if (ImGui::Button("Undo")) {
+        Undo();
+    }
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    ImGui::BeginDisabled(!CanRedo());
+    if (ImGui::Button("Redo")) {
+        Redo();
+    }
+    ImGui::EndDisabled();
+    // Ctrl+Z to undo, Ctrl+Shift+Z or Ctrl+Y to redo
+    if (ImGui::IsWindowFocused(ImGuiFocusedFlags_RootAndChildWindows) && io.KeyCtrl &&
+        !io.WantTextInput) {
+        if (ImGui::IsKeyPressed(ImGuiKey_Z, false)) {
+            if (io.KeyShift) {
+                Redo();
+            } else {
+                Undo();
+            }
+        } else if (ImGui::IsKeyPressed(ImGuiKey_Y, false)) {
+            Redo();
+        }
+    }
+
+    // Undo, Simplify and SetState replace the points, so the selected one may be gone
+    if (control_points_replaced) {
+        control_points_replaced = false;
+        selected_point = -1;
+    }
 
     vec2f canvas_size = ImGui::GetContentRegionAvail();
     canvas_size.y /= 3.f;
@@ -200,23 +182,19 @@ void TransferFunctionWidget::DrawColorMap(bool show_help)
     
     // Draw colormap only below the opacity curve, with opacity fading based on position
     // At the curve: full colormap visibility, at bottom (opacity=0): invisible
-    size_t tmp = colormap_img;
+    size_t tmp = colormap_img.Get();
     const int numStrips = static_cast<int>(canvas_size.x);
+    // Sample the opacity curve once per strip
+    if (canvas_opacity.capacity() < static_cast<size_t>(std::max(numStrips, 0))) {
+        CountAllocation(numStrips * sizeof(float));
+    }
+    canvas_opacity.resize(std::max(numStrips, 0));
+    SampleCurve(alpha_segments, canvas_opacity.size(), canvas_opacity.data());
     for (int i = 0; i < numStrips; ++i) {
         float x = canvas_pos.x + static_cast<float>(i);
         float t = static_cast<float>(i) / canvas_size.x;  // normalized position [0,1]
         
-        // Find the opacity value at this x position by interpolating between control points
-        float opacity = 0.0f;
-        for (size_t j = 0; j < alpha_control_pts.size() - 1; ++j) {
-            if (t >= alpha_control_pts[j].x && t <= alpha_control_pts[j + 1].x) {
-                float segmentT = (t - alpha_control_pts[j].x) / 
-                                 (alpha_control_pts[j + 1].x - alpha_control_pts[j].x);
-                opacity = alpha_control_pts[j].y + segmentT * 
-                         (alpha_control_pts[j + 1].y - alpha_control_pts[j].y);
-                break;
-            }
-        }
+        float opacity = canvas_opacity[i];
         
         // Calculate y position of the curve at this x (screen coords)
         // curveY is where the curve is; below it (higher y) we draw colormap fading to bottom
@@ -258,17 +236,7 @@ void TransferFunctionWidget::DrawColorMap(bool show_help)
         float x = canvas_pos.x + static_cast<float>(i);
         float t = static_cast<float>(i) / canvas_size.x;
         
-        // Find opacity at this x
-        float opacity = 0.0f;
-        for (size_t j = 0; j < alpha_control_pts.size() - 1; ++j) {
-            if (t >= alpha_control_pts[j].x && t <= alpha_control_pts[j + 1].x) {
-                float segmentT = (t - alpha_control_pts[j].x) / 
-                                 (alpha_control_pts[j + 1].x - alpha_control_pts[j].x);
-                opacity = alpha_control_pts[j].y + segmentT * 
-                         (alpha_control_pts[j + 1].y - alpha_control_pts[j].y);
-                break;
-            }
-        }
+        float opacity = canvas_opacity[i];
         
         if (opacity > 0.001f) {
             float curveY = canvas_pos.y + canvas_size.y - opacity * canvas_size.y;
@@ -287,11 +255,18 @@ void TransferFunctionWidget::DrawColorMap(bool show_help)
         }
     }
 
+    DrawHistogram(draw_list, canvas_pos, canvas_size);
+
     draw_list->AddRect(canvas_pos, canvas_pos + canvas_size, ImColor(180, 180, 180, 255));
 
     ImGui::InvisibleButton("tfn_canvas", canvas_size);
+    TrackEditing(EDITING_CANVAS);
+    // The update policy applies from the frame a drag starts on, later frames are held
+    // by RecordEdit
+    if (editing & EDITING_CANVAS) {
+        HoldUpdates(true);
+    }
 
-    static bool clicked_on_item = false;
     if (!io.MouseDown[0] && !io.MouseDown[1]) {
         clicked_on_item = false;
     }
@@ -326,17 +301,26 @@ void TransferFunctionWidget::DrawColorMap(bool show_help)
                         float dist = (pt_pos - vec2f(clipped_mouse_pos)).length();
                         return dist <= point_radius;
                     });
-                // No nearby point, we're adding a new one
+                // No nearby point, we're adding a new one, splitting the segment
+                // it lands on into two with the same interpolation
                 if (fnd == alpha_control_pts.end()) {
+                    auto next = std::upper_bound(
+                        alpha_control_pts.begin(),
+                        alpha_control_pts.end(),
+                        mouse_pos.x,
+                        [](float x, const vec2f &p) { return x < p.x; });
+                    const size_t segment =
+                        std::min(static_cast<size_t>(std::max<ptrdiff_t>(
+                                     next - alpha_control_pts.begin() - 1, 0)),
+                                 alpha_control_modes.size() - 1);
                     alpha_control_pts.push_back(mouse_pos);
+                    alpha_control_modes.push_back(alpha_control_modes[segment]);
                 }
             }
 
             // Keep alpha control points ordered by x coordinate, update
             // selected point index to match
-            std::sort(alpha_control_pts.begin(),
-                      alpha_control_pts.end(),
-                      [](const vec2f &a, const vec2f &b) { return a.x < b.x; });
+            SortControlPoints();
             if (selected_point != 0 && selected_point != alpha_control_pts.size() - 1) {
                 auto fnd = std::find_if(
                     alpha_control_pts.begin(), alpha_control_pts.end(), [&](const vec2f &p) {
@@ -346,7 +330,7 @@ void TransferFunctionWidget::DrawColorMap(bool show_help)
                     });
                 selected_point = std::distance(alpha_control_pts.begin(), fnd);
             }
-            UpdateColormap();
+            UpdateColormapOpacity();
         } else if (ImGui::IsMouseClicked(1)) {
             selected_point = -1;
             // Find and remove the point
@@ -359,9 +343,11 @@ void TransferFunctionWidget::DrawColorMap(bool show_help)
             // We also want to prevent erasing the first and last points
             if (fnd != alpha_control_pts.end() && fnd != alpha_control_pts.begin() &&
                 fnd != alpha_control_pts.end() - 1) {
+                alpha_control_modes.erase(alpha_control_modes.begin() +
+                                          std::distance(alpha_control_pts.begin(), fnd));
                 alpha_control_pts.erase(fnd);
             }
-            UpdateColormap();
+            UpdateColormapOpacity();
         } else {
             selected_point = -1;
         }
@@ -369,31 +355,461 @@ void TransferFunctionWidget::DrawColorMap(bool show_help)
         selected_point = -1;
     }
 
+    // Middle click cycles the interpolation of the segment under the mouse
+    if (ImGui::IsItemHovered() && ImGui::IsMouseClicked(2)) {
+        const float mouse_x = clamp((io.MousePos.x - view_offset.x) / view_scale.x, 0.f, 1.f);
+        for (size_t j = 0; j + 1 < alpha_control_pts.size(); ++j) {
+            if (mouse_x <= alpha_control_pts[j + 1].x) {
+                SetSegmentInterpolationMode(j,
+                    static_cast<InterpolationMode>((alpha_control_modes[j] + 1) %
+                                                   NUM_INTERPOLATION_MODES));
+                break;
+            }
+        }
+    }
+
     // Draw the alpha control points, and build the points for the polyline
-    // which connects them
-    std::vector<ImVec2> polyline_pts;
-    for (const auto &pt : alpha_control_pts) {
-        const vec2f pt_pos = pt * view_scale + view_offset;
+    // which connects them. Curved segments are traced through the opacity sampled
+    // for the strips they cover
+    std::vector<ImVec2> &polyline_pts = canvas_polyline;
+    const size_t polyline_capacity = polyline_pts.capacity();
+    polyline_pts.clear();
+    for (size_t j = 0; j < alpha_control_pts.size(); ++j) {
+        const vec2f pt_pos = alpha_control_pts[j] * view_scale + view_offset;
         polyline_pts.push_back(pt_pos);
         draw_list->AddCircleFilled(pt_pos, point_radius, 0xFFFFFFFF);
+        if (j + 1 < alpha_control_pts.size() && alpha_control_modes[j] != INTERP_LINEAR) {
+            const int first = static_cast<int>(alpha_control_pts[j].x * numStrips) + 1;
+            const int last = std::min(static_cast<int>(alpha_control_pts[j + 1].x * numStrips),
+                                      numStrips - 1);
+            for (int i = first; i <= last; ++i) {
+                const float x = static_cast<float>(i) / numStrips;
+                if (x > alpha_control_pts[j].x && x < alpha_control_pts[j + 1].x) {
+                    polyline_pts.push_back(vec2f(x, canvas_opacity[i]) * view_scale + view_offset);
+                }
+            }
+        }
+    }
+    if (polyline_pts.capacity() != polyline_capacity) {
+        CountAllocation(polyline_pts.capacity() * sizeof(ImVec2));
     }
     draw_list->AddPolyline(
         polyline_pts.data(), (int)polyline_pts.size(), 0xFFFFFFFF, false, 2.f);
     draw_list->PopClipRect();
 }
 
-bool TransferFunctionWidget::DrawOpacityScale()
+void TransferFunctionWidget::DrawStatsPanel()
+{
+    if(noGui && !headless)
+    {
+        std::cerr << "TransferFunctionWidget::DrawStatsPanel() called with noGui set to true\n";
+        return;
+    }
+    const PerformanceCounters &c = perf_counters;
+    if (ImGui::BeginTable("##counters", 2, ImGuiTableFlags_RowBg)) {
+        auto row = [](const char *name, uint64_t value) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(name);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(value));
+        };
+        row("Table rebuilds", c.table_rebuilds);
+        row("Partial table updates", c.partial_table_updates);
+        row("Texels recomputed", c.texels_recomputed);
+        row("GPU uploads", c.gpu_uploads);
+        row("GPU upload bytes", c.gpu_upload_bytes);
+        row("Snapshots published", c.snapshots_published);
+        row("Allocations", c.allocations);
+        row("Allocated bytes", c.allocated_bytes);
+        ImGui::EndTable();
+    }
+    if (ImGui::BeginTable("##timings", 4, ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Operation");
+        ImGui::TableSetupColumn("Calls");
+        ImGui::TableSetupColumn("Mean (us)");
+        ImGui::TableSetupColumn("Max (us)");
+        ImGui::TableHeadersRow();
+        auto row = [](const char *name, const TimingCounter &t) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(name);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(t.calls));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", t.MeanMicroseconds());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", t.max_ns / 1000.0);
+        };
+        row("UpdateColormap", c.update_colormap);
+        row("UpdateGPUImage", c.update_gpu_image);
+        row("DrawColorMap", c.draw_colormap);
+        ImGui::EndTable();
+    }
+    if (ImGui::Button("Reset Counters")) {
+        ResetPerformanceCounters();
+    }
+}
+
+void TransferFunctionWidget::SetHeadless(bool enabled)
+{
+    headless = enabled;
+}
+
+void TransferFunctionWidget::SetMode2D(bool enabled)
 {
+    mode_2d = enabled;
+}
+
+bool TransferFunctionWidget::IsMode2D() const
+{
+    return mode_2d;
+}
+
+TransferFunction2D &TransferFunctionWidget::GetTransferFunction2D()
+{
+    return tfn_2d;
+}
+
+void TransferFunctionWidget::DrawColorMap2D(bool show_help)
+{
+    const ImGuiIO &io = ImGui::GetIO();
+
+    if (show_help) {
+        ImGui::Text("2D Transfer Function (value x gradient magnitude)");
+        ImGui::TextWrapped(
+            "Left click + drag to move primitives, drag the corner handle to resize. "
+            "Right click to remove a primitive.");
+    }
+
+    TransferFunction2DPrimitive added;
+    added.color[3] = 0.5f;
+    bool add_primitive = false;
+    if (ImGui::Button("Add Rectangle")) {
+        added.type = TransferFunction2DPrimitive::RECTANGLE;
+        added.min_x = 0.4f;
+        added.max_x = 0.6f;
+        added.min_y = 0.f;
+        added.max_y = 0.5f;
+        add_primitive = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Add Triangle")) {
+        added.type = TransferFunction2DPrimitive::TRIANGLE;
+        added.min_x = 0.35f;
+        added.max_x = 0.65f;
+        added.min_y = 0.f;
+        added.max_y = 0.8f;
+        add_primitive = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear")) {
+        tfn_2d.Clear();
+        selected_primitive = -1;
+        primitive_drag = DRAG_NONE;
+    }
+    if (add_primitive) {
+        selected_primitive = tfn_2d.AddPrimitive(added);
+    }
+
+    vec2f canvas_size = ImGui::GetContentRegionAvail();
+    canvas_size.y /= 3.f;
+    vec2f canvas_pos = ImGui::GetCursorScreenPos();
+
+    const float handle_radius = 6.f;
+    const vec2f view_scale(canvas_size.x, -canvas_size.y);
+    const vec2f view_offset(canvas_pos.x, canvas_pos.y + canvas_size.y);
+
+    ImGui::InvisibleButton("tfn_2d_canvas", canvas_size);
+    const bool hovered = ImGui::IsItemHovered();
+
+    vec2f mouse_pos = (vec2f(io.MousePos) - view_offset) / view_scale;
+    mouse_pos.x = clamp(mouse_pos.x, 0.f, 1.f);
+    mouse_pos.y = clamp(mouse_pos.y, 0.f, 1.f);
+
+    auto handle_pos = [&](const TransferFunction2DPrimitive &p) {
+        return vec2f(std::max(p.min_x, p.max_x), std::max(p.min_y, p.max_y)) * view_scale +
+               view_offset;
+    };
+    auto contains = [&](const TransferFunction2DPrimitive &p) {
+        return mouse_pos.x >= std::min(p.min_x, p.max_x) &&
+               mouse_pos.x <= std::max(p.min_x, p.max_x) &&
+               mouse_pos.y >= std::min(p.min_y, p.max_y) &&
+               mouse_pos.y <= std::max(p.min_y, p.max_y);
+    };
+
+    // Pick the topmost primitive (or its resize handle) under the mouse
+    if (hovered && ImGui::IsMouseClicked(0)) {
+        selected_primitive = -1;
+        primitive_drag = DRAG_NONE;
+        for (size_t i = tfn_2d.NumPrimitives(); i-- > 0;) {
+            const TransferFunction2DPrimitive &p = tfn_2d.GetPrimitive(i);
+            if ((handle_pos(p) - vec2f(io.MousePos)).length() <= handle_radius) {
+                primitive_drag = DRAG_RESIZE;
+            } else if (contains(p)) {
+                primitive_drag = DRAG_MOVE;
+            } else {
+                continue;
+            }
+            selected_primitive = i;
+            primitive_drag_start = mouse_pos;
+            primitive_drag_origin = p;
+            break;
+        }
+    }
+
+    if (primitive_drag != DRAG_NONE && io.MouseDown[0] &&
+        selected_primitive < tfn_2d.NumPrimitives()) {
+        const TransferFunction2DPrimitive &origin = primitive_drag_origin;
+        TransferFunction2DPrimitive p = origin;
+        const vec2f delta = mouse_pos - primitive_drag_start;
+        if (primitive_drag == DRAG_MOVE) {
+            // Keep the whole primitive inside the canvas
+            const float dx = clamp(delta.x,
+                                   -std::min(origin.min_x, origin.max_x),
+                                   1.f - std::max(origin.min_x, origin.max_x));
+            const float dy = clamp(delta.y,
+                                   -std::min(origin.min_y, origin.max_y),
+                                   1.f - std::max(origin.min_y, origin.max_y));
+            p.min_x += dx;
+            p.max_x += dx;
+            p.min_y += dy;
+            p.max_y += dy;
+        } else {
+            p.max_x = clamp(origin.max_x + delta.x, origin.min_x + 0.01f, 1.f);
+            p.max_y = clamp(origin.max_y + delta.y, origin.min_y + 0.01f, 1.f);
+        }
+        // Holding the mouse still, or just clicking to select, must not re-rasterize
+        const TransferFunction2DPrimitive &current = tfn_2d.GetPrimitive(selected_primitive);
+        if (p.min_x != current.min_x || p.min_y != current.min_y || p.max_x != current.max_x ||
+            p.max_y != current.max_y) {
+            tfn_2d.SetPrimitive(selected_primitive, p);
+        }
+    } else if (!io.MouseDown[0]) {
+        primitive_drag = DRAG_NONE;
+    }
+
+    if (hovered && ImGui::IsMouseClicked(1)) {
+        for (size_t i = tfn_2d.NumPrimitives(); i-- > 0;) {
+            if (contains(tfn_2d.GetPrimitive(i))) {
+                tfn_2d.RemovePrimitive(i);
+                if (selected_primitive == i) {
+                    selected_primitive = -1;
+                    primitive_drag = DRAG_NONE;
+                } else if (selected_primitive != (size_t)-1 && selected_primitive > i) {
+                    --selected_primitive;
+                }
+                break;
+            }
+        }
+    }
+
+    // Rasterize this frame's edits and draw the table with the primitive outlines,
+    // gradient magnitude increases upwards
+    UpdateGPUImage2D();
+
+    ImDrawList *draw_list = ImGui::GetWindowDrawList();
+    draw_list->PushClipRect(canvas_pos, canvas_pos + canvas_size);
+    draw_list->AddRectFilled(
+        canvas_pos, canvas_pos + canvas_size, ImColor(ImGui::GetStyleColorVec4(ImGuiCol_WindowBg)));
+    size_t tex = colormap_2d_img.Get();
+    draw_list->AddImage(reinterpret_cast<void *>(tex),
+                        canvas_pos,
+                        canvas_pos + canvas_size,
+                        ImVec2(0.f, 1.f),
+                        ImVec2(1.f, 0.f));
+
+    for (size_t i = 0; i < tfn_2d.NumPrimitives(); ++i) {
+        const TransferFunction2DPrimitive &p = tfn_2d.GetPrimitive(i);
+        const ImU32 color = i == selected_primitive ? 0xFFFFFFFF : 0xFFA0A0A0;
+        const vec2f lo = vec2f(p.min_x, p.min_y) * view_scale + view_offset;
+        const vec2f hi = vec2f(p.max_x, p.max_y) * view_scale + view_offset;
+        if (p.type == TransferFunction2DPrimitive::TRIANGLE) {
+            draw_list->AddTriangle(ImVec2(0.5f * (lo.x + hi.x), lo.y),
+                                   ImVec2(hi.x, hi.y),
+                                   ImVec2(lo.x, hi.y),
+                                   color,
+                                   2.f);
+            draw_list->AddRect(ImVec2(lo.x, hi.y), ImVec2(hi.x, lo.y), 0x40FFFFFF);
+        } else {
+            draw_list->AddRect(ImVec2(lo.x, hi.y), ImVec2(hi.x, lo.y), color, 0.f, 0, 2.f);
+        }
+        draw_list->AddCircleFilled(handle_pos(p), handle_radius, color);
+    }
+    draw_list->AddRect(canvas_pos, canvas_pos + canvas_size, ImColor(180, 180, 180, 255));
+    draw_list->PopClipRect();
+
+    if (selected_primitive < tfn_2d.NumPrimitives()) {
+        TransferFunction2DPrimitive p = tfn_2d.GetPrimitive(selected_primitive);
+        if (ImGui::ColorEdit4("Primitive color", p.color)) {
+            tfn_2d.SetPrimitive(selected_primitive, p);
+        }
+    }
+}
+
+void TransferFunctionWidget::UpdateGPUImage2D()
+{
+    // Headless drawing keeps the texture IDs but never creates the textures
+    if (headless) {
+        return;
+    }
     if(noGui)
+    {
+        std::cerr << "TransferFunctionWidget::UpdateGPUImage2D() called with noGui set to true\n";
+        return;
+    }
+    const std::vector<uint8_t> &table = tfn_2d.GetTable();
+    const int width = tfn_2d.Width();
+    const int height = tfn_2d.Height();
+
+    GLint prev_tex_2d = 0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &prev_tex_2d);
+
+    if (!colormap_2d_img.Valid()) {
+        colormap_2d_img.Create();
+        glBindTexture(GL_TEXTURE_2D, colormap_2d_img.Get());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D,
+                     0,
+                     GL_RGBA8,
+                     width,
+                     height,
+                     0,
+                     GL_RGBA,
+                     GL_UNSIGNED_BYTE,
+                     table.data());
+        tfn_2d_gpu_version = tfn_2d.Version();
+        ++perf_counters.gpu_uploads;
+        perf_counters.gpu_upload_bytes += table.size();
+    } else if (tfn_2d_gpu_version != tfn_2d.Version()) {
+        // Only upload the texels changed since the last upload
+        const TexelRect r = tfn_2d.ChangedSince(tfn_2d_gpu_version);
+        tfn_2d_gpu_version = tfn_2d.Version();
+        ++perf_counters.gpu_uploads;
+        perf_counters.gpu_upload_bytes += static_cast<size_t>(r.x1 - r.x0) * (r.y1 - r.y0) * 4;
+        glBindTexture(GL_TEXTURE_2D, colormap_2d_img.Get());
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+        glTexSubImage2D(GL_TEXTURE_2D,
+                        0,
+                        r.x0,
+                        r.y0,
+                        r.x1 - r.x0,
+                        r.y1 - r.y0,
+                        GL_RGBA,
+                        GL_UNSIGNED_BYTE,
+                        table.data() + (static_cast<size_t>(r.y0) * width + r.x0) * 4);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, prev_tex_2d);
+}
+
+void TransferFunctionWidget::DrawHistogram(ImDrawList *draw_list,
+                                           const ImVec2 &canvas_pos,
+                                           const ImVec2 &canvas_size)
+{
+    if (histogram.Empty()) {
+        return;
+    }
+    // Two pixels per bar, re-binned only when the range, size or scale changes
+    const size_t num_bins = static_cast<size_t>(clamp(canvas_size.x / 2.f, 1.f, 512.f));
+    if (histogram_display_stale || histogram_display.size() != num_bins ||
+        histogram_display_range.x != range.x || histogram_display_range.y != range.y ||
+        histogram_display_log_scale != histogram_log_scale) {
+        const float span = histogram.max - histogram.min;
+        histogram_display = histogram.Rebin(
+            histogram.min + range.x * span, histogram.min + range.y * span, num_bins);
+        float max_count = 0.f;
+        for (auto &c : histogram_display) {
+            if (histogram_log_scale) {
+                c = std::log1p(c);
+            }
+            max_count = std::max(max_count, c);
+        }
+        if (max_count > 0.f) {
+            for (auto &c : histogram_display) {
+                c /= max_count;
+            }
+        }
+        histogram_display_range = range;
+        histogram_display_log_scale = histogram_log_scale;
+        histogram_display_stale = false;
+    }
+
+    const float bar_width = canvas_size.x / num_bins;
+    const float bottom = canvas_pos.y + canvas_size.y;
+    for (size_t i = 0; i < num_bins; ++i) {
+        if (histogram_display[i] <= 0.f) {
+            continue;
+        }
+        const float x = canvas_pos.x + i * bar_width;
+        draw_list->AddRectFilled(ImVec2(x, bottom - histogram_display[i] * canvas_size.y),
+                                 ImVec2(x + bar_width, bottom),
+                                 ImColor(200, 200, 200, 90));
+    }
+}
+
+void TransferFunctionWidget::SetHistogram(const Histogram &hist)
+{
+    histogram = hist;
+    histogram_display_stale = true;
+}
+
+void TransferFunctionWidget::ClearHistogram()
+{
+    histogram = Histogram();
+    histogram_display.clear();
+    histogram_display_stale = true;
+    has_data_statistics = false;
+}
+
+void TransferFunctionWidget::SetVolumeStatistics(const VolumeStatistics &stats)
+{
+    SetHistogram(stats.histogram);
+    data_statistics = stats;
+    has_data_statistics = true;
+    if (!stats.quantiles.Empty())
+    {
+        SetQuantileSketch(stats.quantiles);
+    }
+}
+
+void TransferFunctionWidget::SetQuantileSketch(const QuantileSketch &sketch)
+{
+    quantile_sketch = sketch;
+    has_quantile_sketch = true;
+}
+
+const Histogram &TransferFunctionWidget::GetHistogram() const
+{
+    return histogram;
+}
+
+void TransferFunctionWidget::SetHistogramLogScale(bool log_scale)
+{
+    histogram_log_scale = log_scale;
+}
+
+bool TransferFunctionWidget::DrawOpacityScale()
+{
+    if(noGui && !headless)
     {
         std::cerr << "TransferFunctionWidget::DrawOpacityScale() called with noGui set to true\n";
         return false;
     }
+    RecordEdit(editing != 0);
     ImGui::Text("Opacity scale");
     ImGui::SameLine();
-    if (ImGui::SliderFloat("##1", &opacity_scale, 0.0f, 1.0f))
+    const bool changed = ImGui::SliderFloat("##1", &opacity_scale, 0.0f, 1.0f);
+    TrackEditing(EDITING_OPACITY_SCALE);
+    if (changed)
     {
-        opacity_scale_changed = true;
+        if (editing & EDITING_OPACITY_SCALE) {
+            HoldUpdates(true);
+        }
+        NotifyChanged(CHANGED_OPACITY_SCALE);
         UpdateColormap();
         return true;
     }
@@ -402,7 +818,7 @@ bool TransferFunctionWidget::DrawOpacityScale()
 
 bool TransferFunctionWidget::DrawRuler(vec2f data_range)
 {
-    if(noGui)
+    if(noGui && !headless)
     {
         std::cerr << "TransferFunctionWidget::DrawRuler() called with noGui set to true\n";
         return false;
@@ -484,403 +900,110 @@ bool TransferFunctionWidget::DrawRuler(vec2f data_range)
 
 bool TransferFunctionWidget::DrawRanges()
 {
-    if(noGui)
+    if(noGui && !headless)
     {
         std::cerr << "TransferFunctionWidget::DrawRanges() called with noGui set to true\n";
         return false;
     }
+    RecordEdit(editing != 0);
+    // Items which aren't drawn this frame aren't active
+    editing &= ~(EDITING_RANGE | EDITING_PERCENTILES | EDITING_VALUES);
+    // Every row is drawn even on frames the range changes, so they don't flicker
+    bool changed = false;
     ImGui::Text("Range:");
     ImGui::SameLine();
-    if (ImGui::InputFloat2("##2", &range.x, "%.3f"))
+    const bool range_edited = ImGui::InputFloat2("##2", &range.x, "%.3f");
+    TrackEditing(EDITING_RANGE);
+    if (range_edited)
     {
         //clamp min below max and max over min
         range.x = std::min(range.x, range.y-1e-6f);
         range.y = std::max(range.x+1e-6f, range.y);
-        range_changed = true;
-        return true;
-    }
-    return false;
-}
-
-void TransferFunctionWidget::OverlayColormapBar(std::vector<uint32_t>& image, int imageWidth, int imageHeight, 
-                                               vec2f pos, vec2f dataRange, float scale, bool flip_vertically)
-{
-    // Base dimensions for the colormap bar
-    const int baseBarWidth = 40;
-    const int baseBarHeight = 200;
-    const int baseTickLength = 8;
-    const int numTicks = 5; // Including min and max
-    
-    // Scale the dimensions
-    const int barWidth = static_cast<int>(baseBarWidth * scale);
-    const int barHeight = static_cast<int>(baseBarHeight * scale);
-    const int tickLength = static_cast<int>(baseTickLength * scale);
-    
-    // Calculate bar position using distance from bottom-left corner
-    // pos.x is distance from left edge, pos.y is distance from bottom edge
-    // Account for vertical flipping if enabled
-    int barX = static_cast<int>(pos.x);
-    int barY;
-    if (flip_vertically) {
-        // When vertically flipped, top becomes bottom, so use pos.y directly from top
-        barY = static_cast<int>(pos.y);
-    } else {
-        // Normal case: convert from bottom-left to top-left coordinates
-        barY = imageHeight - static_cast<int>(pos.y) - barHeight;
+        NotifyChanged(CHANGED_RANGE);
+        PublishSnapshot();
+        changed = true;
     }
-    
-    // Skip if bar would be outside the image
-    if (barX < 0 || barY < 0 || pos.x >= imageWidth || pos.y >= imageHeight) return;
-    
-    // Get colormap data
-    auto colormap = GetColormap();
-    if (colormap.empty()) return;
-    
-    // Draw the colormap bar (vertical)
-    for (int y = 0; y < barHeight; ++y) {
-        // Map y position to colormap index 
-        // Account for vertical flipping
-        float t;
-        if (flip_vertically) {
-            // When flipped, y=0 (top of bar) should show minimum value (t=0)
-            // y=barHeight-1 (bottom of bar) should show maximum value (t=1)
-            t = (float)y / (barHeight - 1);
-        } else {
-            // Normal case: y=0 (top of bar) should show maximum value (t=1)
-            // y=barHeight-1 (bottom of bar) should show minimum value (t=0)
-            t = 1.0f - (float)y / (barHeight - 1);
-        }
-        int cmapIndex = static_cast<int>(t * (colormap.size() / 4 - 1)) * 4;
-        cmapIndex = std::max(0, std::min(cmapIndex, static_cast<int>(colormap.size()) - 4));
-        
-        // Extract RGBA values from colormap
-        uint8_t r = colormap[cmapIndex + 0];
-        uint8_t g = colormap[cmapIndex + 1];
-        uint8_t b = colormap[cmapIndex + 2];
-        uint8_t a = colormap[cmapIndex + 3];
-        
-        // Convert to uint32_t (assuming RGBA format)
-        uint32_t color = (a << 24) | (b << 16) | (g << 8) | r;
-        
-        // Draw horizontal line for this color
-        for (int x = 0; x < barWidth; ++x) {
-            int pixelX = barX + x;
-            int pixelY = barY + y;
-            
-            if (pixelX >= 0 && pixelX < imageWidth && 
-                pixelY >= 0 && pixelY < imageHeight) {
-                int pixelIndex = pixelY * imageWidth + pixelX;
-                image[pixelIndex] = color;
-            }
-        }
-    }
-    
-    // Calculate the actual data range that the transfer function covers
-    ImVec2 tfRange = GetRange();
-    const float dataSpan = dataRange.y - dataRange.x;
-    const float actualMin = dataRange.x + tfRange.x * dataSpan;
-    const float actualMax = dataRange.x + tfRange.y * dataSpan;
-    const float actualSpan = actualMax - actualMin;
-    
-    // Draw ticks and labels
-    for (int tick = 0; tick < numTicks; ++tick) {
-        float t = static_cast<float>(tick) / (numTicks - 1);
-        // Calculate tick position accounting for vertical flipping
-        int tickY;
-        if (flip_vertically) {
-            // When flipped, tick=0 should be at top (min value), tick=numTicks-1 should be at bottom (max value)
-            tickY = barY + static_cast<int>(t * (barHeight - 1));
-        } else {
-            // Normal case: tick=0 should be at bottom (min value), tick=numTicks-1 should be at top (max value)
-            tickY = barY + barHeight - 1 - static_cast<int>(t * (barHeight - 1));
-        }
-        float value = actualMin + t * actualSpan;
-        
-        // Draw tick mark (white line extending to the right)
-        uint32_t tickColor = 0xFFFFFFFF; // White
-        for (int i = 0; i < tickLength; ++i) {
-            int tickX = barX + barWidth + i;
-            if (tickX < imageWidth && tickY >= 0 && tickY < imageHeight) {
-                int pixelIndex = tickY * imageWidth + tickX;
-                image[pixelIndex] = tickColor;
-            }
-        }
-        
-        // Draw simple number text
-        DrawBitmapNumber(image, imageWidth, imageHeight, value, 
-                        barX + barWidth + tickLength + 2, tickY - 4, scale, flip_vertically);
-    }
-    
-    // Draw border around the colormap bar
-    uint32_t borderColor = 0xFFFFFFFF; // White border
-    // Top and bottom borders
-    for (int x = 0; x < barWidth; ++x) {
-        int topPixelIndex = barY * imageWidth + (barX + x);
-        int bottomPixelIndex = (barY + barHeight - 1) * imageWidth + (barX + x);
-        if (barX + x >= 0 && barX + x < imageWidth) {
-            if (barY >= 0 && barY < imageHeight)
-                image[topPixelIndex] = borderColor;
-            if (barY + barHeight - 1 >= 0 && barY + barHeight - 1 < imageHeight)
-                image[bottomPixelIndex] = borderColor;
-        }
-    }
-    // Left and right borders
-    for (int y = 0; y < barHeight; ++y) {
-        int leftPixelIndex = (barY + y) * imageWidth + barX;
-        int rightPixelIndex = (barY + y) * imageWidth + (barX + barWidth - 1);
-        if (barY + y >= 0 && barY + y < imageHeight) {
-            if (barX >= 0 && barX < imageWidth)
-                image[leftPixelIndex] = borderColor;
-            if (barX + barWidth - 1 >= 0 && barX + barWidth - 1 < imageWidth)
-                image[rightPixelIndex] = borderColor;
-        }
-    }
-}
-
-void TransferFunctionWidget::DrawBitmapNumber(std::vector<uint32_t>& image, int imageWidth, int imageHeight, 
-                                             float value, int x, int y, float scale, bool flip_vertically)
-{
-    // Format the number
-    char buffer[32];
-    if (std::abs(value) < 0.01f && value != 0.0f) {
-        snprintf(buffer, sizeof(buffer), "%.1e", value);
-    } else if (std::abs(value) >= 1000.0f) {
-        snprintf(buffer, sizeof(buffer), "%.1e", value);
-    } else {
-        snprintf(buffer, sizeof(buffer), "%.2f", value);
-    }
-    
-    // Simple 5x7 bitmap font for digits and basic characters
-    // Each row represents a horizontal scan line from top to bottom
-    // Bits are read from MSB to LSB (left to right)
-    static const uint8_t font5x7[][7] = {
-        {0x70, 0x88, 0x88, 0x88, 0x88, 0x88, 0x70}, // '0'
-        {0x20, 0x60, 0x20, 0x20, 0x20, 0x20, 0x70}, // '1'
-        {0x70, 0x88, 0x08, 0x10, 0x20, 0x40, 0xF8}, // '2'
-        {0xF8, 0x10, 0x20, 0x10, 0x08, 0x88, 0x70}, // '3'
-        {0x10, 0x30, 0x50, 0x90, 0xF8, 0x10, 0x10}, // '4'
-        {0xF8, 0x80, 0xF0, 0x08, 0x08, 0x88, 0x70}, // '5'
-        {0x30, 0x40, 0x80, 0xF0, 0x88, 0x88, 0x70}, // '6'
-        {0xF8, 0x08, 0x10, 0x20, 0x40, 0x40, 0x40}, // '7'
-        {0x70, 0x88, 0x88, 0x70, 0x88, 0x88, 0x70}, // '8'
-        {0x70, 0x88, 0x88, 0x78, 0x08, 0x10, 0x60}, // '9'
-        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // ' ' (space)
-        {0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x60}, // '.'
-        {0x00, 0x00, 0x00, 0xF8, 0x00, 0x00, 0x00}, // '-'
-        {0x70, 0x88, 0x08, 0x10, 0x20, 0x00, 0x20}, // '?'
-        {0x70, 0x88, 0x88, 0xA8, 0xA8, 0xB0, 0x70}, // '@' (used for 'e' in scientific notation)
-        {0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0xF8}, // '+' 
-    };
-    
-    // Character mapping
-    auto getCharIndex = [](char c) -> int {
-        if (c >= '0' && c <= '9') return c - '0';
-        switch (c) {
-            case ' ': return 10;
-            case '.': return 11;
-            case '-': return 12;
-            case '?': return 13; // fallback
-            case 'e': case 'E': return 14; // for scientific notation
-            case '+': return 15;
-            default: return 13; // '?' as fallback
+    if (has_quantile_sketch)
+    {
+        ImGui::Text("Percentiles:");
+        ImGui::SameLine();
+        const bool percentiles_edited =
+            ImGui::InputFloat2("##percentiles", &auto_range_percentiles.x, "%.1f");
+        TrackEditing(EDITING_PERCENTILES);
+        if (percentiles_edited)
+        {
+            SetAutoRangePercentiles(auto_range_percentiles.x, auto_range_percentiles.y);
         }
-    };
-    
-    uint32_t textColor = 0xFFFFFFFF; // White
-    const int baseCharWidth = 6; // 5 pixels + 1 spacing
-    const int baseCharHeight = 7;
-    const int charWidth = static_cast<int>(baseCharWidth * scale);
-    const int charHeight = static_cast<int>(baseCharHeight * scale);
-    
-    // Draw each character
-    for (int charIdx = 0; buffer[charIdx] != '\0' && charIdx < 10; ++charIdx) {
-        int charX = x + charIdx * charWidth;
-        int fontIdx = getCharIndex(buffer[charIdx]);
-        
-        // Draw the character bitmap with scaling
-        for (int row = 0; row < baseCharHeight; ++row) {
-            // When flip_vertically is true, draw from bottom to top to pre-compensate for image flip
-            int actualRow = flip_vertically ? (baseCharHeight - 1 - row) : row;
-            uint8_t rowData = font5x7[fontIdx][actualRow];
-            for (int col = 0; col < 5; ++col) {
-                // Check bit from MSB to LSB (left to right) - bit 7,6,5,4,3
-                if (rowData & (0x80 >> col)) {
-                    // Draw scaled pixel block
-                    for (int sy = 0; sy < static_cast<int>(scale); ++sy) {
-                        for (int sx = 0; sx < static_cast<int>(scale); ++sx) {
-                            int pixelX = charX + col * static_cast<int>(scale) + sx;
-                            int pixelY = y + row * static_cast<int>(scale) + sy;
-                            
-                            if (pixelX >= 0 && pixelX < imageWidth && 
-                                pixelY >= 0 && pixelY < imageHeight) {
-                                int pixelIndex = pixelY * imageWidth + pixelX;
-                                image[pixelIndex] = textColor;
-                            }
-                        }
-                    }
-                }
-            }
+        ImGui::SameLine();
+        if (ImGui::Button("Auto Range"))
+        {
+            // Percentiles are relative to the full data range when known
+            const vec2f data_range = has_data_statistics
+                                         ? vec2f(data_statistics.min, data_statistics.max)
+                                         : vec2f(quantile_sketch.Min(), quantile_sketch.Max());
+            changed |= AutoRange(quantile_sketch, data_range);
         }
     }
-}
-
-bool TransferFunctionWidget::LoadState(const std::string &filepath)
-{
-    // Read the file
-    std::ifstream fp;
-    fp.open(filepath, std::ios::in | std::ios::binary);
-    if (!fp.is_open()) {
-        printf("Could not open file %s\n", filepath.c_str());
-        return false;
-    }
-
-    // Read the opacity scale
-    fp >> opacity_scale;
-
-    // Read the range
-    fp >> range.x >> range.y;
-
-    // Read the current colormap size
-    uint32_t current_colormap_size;
-    fp >> current_colormap_size;
-    fp.ignore();  // Ignore the newline character
-
-    // Read the current colormap
-    current_colormap.clear();
-    current_colormap.resize(current_colormap_size);
-    fp.read(reinterpret_cast<char*>(current_colormap.data()), current_colormap_size * sizeof(uint8_t));
-
-    std::string colormap_name;
-    std::getline(fp, colormap_name);  // Read the entire line as the colormap name
-
-    // If the colormap name is not "custom," then look through the list of colormaps
-    // names and set the selected_colormap variable to its index
-    if (colormap_name != "custom") {
-        for (int i = 0; i < colormaps.size(); i++) {
-            if (colormaps[i].name == colormap_name) {
-                selected_colormap = i;
-                break;
-            }
-        }
-    }
-    else {
-        LoadEmbeddedPreset(reinterpret_cast<uint8_t*>(current_colormap.data()), current_colormap.size(), "custom");
+    if (!has_data_statistics)
+    {
+        return changed;
     }
 
-    // Read the control points
-    size_t num_pts;
-    fp >> num_pts;
-    alpha_control_pts.clear();
-    alpha_control_pts.resize(num_pts);
-    for (auto &pt : alpha_control_pts) {
-        fp >> pt.x;
-        fp >> pt.y;
+    const float data_min = data_statistics.min;
+    const float span = data_statistics.max - data_statistics.min;
+    ImGui::Text("Data: [%g, %g], mean %g", data_min, data_statistics.max, data_statistics.mean);
+    // Edit the range in data values, mapped back to the relative range
+    ImVec2 values(data_min + range.x * span, data_min + range.y * span);
+    ImGui::Text("Values:");
+    ImGui::SameLine();
+    const bool values_edited = ImGui::InputFloat2("##values", &values.x, "%g");
+    TrackEditing(EDITING_VALUES);
+    if (values_edited && span > 0.f)
+    {
+        range.x = (values.x - data_min) / span;
+        range.y = (values.y - data_min) / span;
+        range.x = std::min(range.x, range.y-1e-6f);
+        range.y = std::max(range.x+1e-6f, range.y);
+        NotifyChanged(CHANGED_RANGE);
+        PublishSnapshot();
+        changed = true;
     }
-    fp.close();
-    printf("Transferfunction read from file %s\n", filepath.c_str());
-    UpdateColormap();
-    UpdateGPUImage();
-    return true;
+    return changed;
 }
 
-bool TransferFunctionWidget::SaveState(const std::string &filepath)
+void TransferFunctionWidget::TrackEditing(EditingItem item)
 {
-    //create file and write to it
-    std::ofstream fp;
-    fp.open(filepath, std::ios::out | std::ios::binary);
-    //clear the file
-    fp.clear();
-
-    if (!fp.is_open()) {
-        printf("Could not open file %s\n", filepath.c_str());
-        return false;
-    }
-    fp << opacity_scale << std::endl << range.x << " " << range.y << std::endl;
-    fp << current_colormap.size() << std::endl;
-
-    // Write the color map as binary data
-    fp.write(reinterpret_cast<char*>(current_colormap.data()), current_colormap.size() * sizeof(uint8_t));
-
-    //write the name of the colormap
-    if (selected_colormap >= 0 && selected_colormap < colormaps.size())
-        fp << colormaps[selected_colormap].name << std::endl;
-    else
-        fp << "custom" << std::endl;
-
-    //write control point positions
-    fp << alpha_control_pts.size() << std::endl;
-    for (const auto &pt : alpha_control_pts) {
-        fp << pt.x << " " << pt.y << std::endl;
+    if (ImGui::IsItemActive()) {
+        editing |= item;
+    } else {
+        editing &= ~item;
     }
-    fp.close();
-    printf("Transferfunction written to file %s\n", filepath.c_str());
-    return true;
 }
 
 bool TransferFunctionWidget::Changed() const
 {
-    return colormap_changed || opacity_scale_changed || range_changed;
-}
-
-bool TransferFunctionWidget::ColorMapChanged() const
-{
-    return colormap_changed;
+    return TransferFunctionEngine::Changed() || (mode_2d && ColorMap2DChanged());
 }
 
-bool TransferFunctionWidget::OpacityScaleChanged() const
+bool TransferFunctionWidget::ColorMap2DChanged() const
 {
-    return opacity_scale_changed;
+    return tfn_2d_read_version != tfn_2d.Version();
 }
 
-bool TransferFunctionWidget::RangeChanged() const
+const std::vector<uint8_t> &TransferFunctionWidget::GetColormap2D()
 {
-    return range_changed;
-}
-
-std::vector<uint8_t> TransferFunctionWidget::GetColormap()
-{
-    colormap_changed = false;
-    return current_colormap;
-}
-
-std::vector<float> TransferFunctionWidget::GetColormapf()
-{
-    colormap_changed = false;
-    std::vector<float> colormapf(current_colormap.size(), 0.f);
-    for (size_t i = 0; i < current_colormap.size(); ++i) {
-        colormapf[i] = current_colormap[i] / 255.f;
-    }
-    return colormapf;
-}
-
-void TransferFunctionWidget::GetColormapf(std::vector<float> &color,
-                                           std::vector<float> &opacity)
-{
-    colormap_changed = false;
-    color.resize((current_colormap.size() / 4) * 3);
-    opacity.resize(current_colormap.size() / 4);
-    for (size_t i = 0; i < current_colormap.size() / 4; ++i) {
-        color[i * 3] = current_colormap[i * 4] / 255.f;
-        color[i * 3 + 1] = current_colormap[i * 4 + 1] / 255.f;
-        color[i * 3 + 2] = current_colormap[i * 4 + 2] / 255.f;
-        opacity[i] = current_colormap[i * 4 + 3] / 255.f;
-    }
-}
-
-float TransferFunctionWidget::GetOpacityScale()
-{
-    opacity_scale_changed = false;
-    return opacity_scale;
-}
-
-ImVec2 TransferFunctionWidget::GetRange()
-{
-    range_changed = false;
-    return range;
+    const std::vector<uint8_t> &table = tfn_2d.GetTable();
+    tfn_2d_read_version = tfn_2d.Version();
+    return table;
 }
 
 void TransferFunctionWidget::UpdateGPUImage()
 {
+    TFN_TRACE_ZONE("TransferFunctionWidget::UpdateGPUImage");
+    // Headless drawing keeps the texture IDs but never creates the textures
+    if (headless) {
+        return;
+    }
     if(noGui)
     {
         std::cerr << "TransferFunctionWidget::UpdateGPUImage() called with noGui set to true\n";
@@ -889,17 +1012,20 @@ void TransferFunctionWidget::UpdateGPUImage()
     GLint prev_tex_2d = 0;
     glGetIntegerv(GL_TEXTURE_BINDING_2D, &prev_tex_2d);
 
-    if (colormap_img == (GLuint)-1) {
-        glGenTextures(1, &colormap_img);
-        glBindTexture(GL_TEXTURE_2D, colormap_img);
+    if (!colormap_img.Valid()) {
+        colormap_img.Create();
+        glBindTexture(GL_TEXTURE_2D, colormap_img.Get());
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     }
-    if (gpu_image_stale) {
-        gpu_image_stale = false;
-        glBindTexture(GL_TEXTURE_2D, colormap_img);
+    if (gpu_table_version != colormap_version) {
+        gpu_table_version = colormap_version;
+        ScopedTimer timer(perf_counters.update_gpu_image);
+        ++perf_counters.gpu_uploads;
+        perf_counters.gpu_upload_bytes += current_colormap.size();
+        glBindTexture(GL_TEXTURE_2D, colormap_img.Get());
         glTexImage2D(GL_TEXTURE_2D,
                      0,
                      GL_RGB8,
@@ -913,44 +1039,4 @@ void TransferFunctionWidget::UpdateGPUImage()
     glBindTexture(GL_TEXTURE_2D, prev_tex_2d);
 }
 
-void TransferFunctionWidget::UpdateColormap()
-{
-    colormap_changed = true;
-    gpu_image_stale = true;
-    current_colormap = colormaps[selected_colormap].colormap;
-    // We only change opacities for now, so go through and update the opacity
-    // by blending between the neighboring control points
-    auto a_it = alpha_control_pts.begin();
-    const size_t npixels = current_colormap.size() / 4;
-    for (size_t i = 0; i < npixels; ++i) {
-        float x = static_cast<float>(i) / npixels;
-        auto high = a_it + 1;
-        if (x > high->x) {
-            ++a_it;
-            ++high;
-        }
-        float t = (x - a_it->x) / (high->x - a_it->x);
-        float alpha = (1.f - t) * a_it->y + t * high->y;
-        current_colormap[i * 4 + 3] = static_cast<uint8_t>(clamp(alpha * opacity_scale * 255.f, 0.f, 255.f));
-    }
-}
-
-void TransferFunctionWidget::LoadEmbeddedPreset(const uint8_t *buf,
-                                                  size_t size,
-                                                  const std::string &name)
-{
-    int w, h, n;
-    uint8_t *img_data = stbi_load_from_memory(buf, (int)size, &w, &h, &n, 4);
-    auto img = std::vector<uint8_t>(img_data, img_data + w * 1 * 4);
-    stbi_image_free(img_data);
-    colormaps.emplace_back(name, img, SRGB);
-    Colormap &cmap = colormaps.back();
-    for (size_t i = 0; i < cmap.colormap.size() / 4; ++i) {
-        for (size_t j = 0; j < 3; ++j) {
-            const float x = srgb_to_linear(cmap.colormap[i * 4 + j] / 255.f);
-            cmap.colormap[i * 4 + j] = static_cast<uint8_t>(clamp(x * 255.f, 0.f, 255.f));
-        }
-    }
-}
-
 }
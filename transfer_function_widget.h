@@ -1,102 +1,162 @@
 #pragma once
 
 #include <cstdint>
-#include <string>
 #include <vector>
 #include "gl_core_4_5.h"
+#include "gl_texture.h"
+#include "histogram.h"
 #include "imgui.h"
+#include "quantile_sketch.h"
+#include "transfer_function_2d.h"
+#include "transfer_function_engine.h"
+#include "volume_statistics.h"
 
 namespace ImTF {
 
-enum ColorSpace { LINEAR, SRGB };
-
-struct Colormap {
-    std::string name;
-    // An RGBA8 1D image
-    std::vector<uint8_t> colormap;
-    ColorSpace color_space;
-
-    Colormap(const std::string &name,
-             const std::vector<uint8_t> &img,
-             const ColorSpace color_space);
-};
-
-class TransferFunctionWidget {
-    struct vec2f {
-        float x, y;
-
-        vec2f(float c = 0.f);
-        vec2f(float x, float y);
-        vec2f(const ImVec2 &v);
+// Load the OpenGL functions through gl_core_4_5's ogl_LoadFunctions, which widgets with
+// the GUI enabled need. Only the first successful call in the process loads them, later
+// calls return right away. Thread-safe, called by the widget constructor
+bool LoadOpenGLFunctions();
+
+// Tell the widgets the host has already loaded the OpenGL functions with
+// ogl_LoadFunctions, so they don't load them again
+void SetOpenGLFunctionsLoaded();
+
+// The ImGui editor for a TransferFunctionEngine, which also keeps the colormap in an
+// OpenGL texture for drawing
+class TransferFunctionWidget : public TransferFunctionEngine {
+    std::vector<float> canvas_opacity;
+    // The points of the opacity curve's polyline, reused between frames
+    std::vector<ImVec2> canvas_polyline;
+    size_t selected_point = -1;
 
-        float length() const;
+    // Set while a mouse press that started on this widget's canvas is held
+    bool clicked_on_item = false;
 
-        vec2f operator+(const vec2f &b) const;
-        vec2f operator-(const vec2f &b) const;
-        vec2f operator/(const vec2f &b) const;
-        vec2f operator*(const vec2f &b) const;
-        operator ImVec2() const;
+    // The widget's items being interacted with, updates are held while any of them is.
+    // Other widgets' and the host's items don't hold this widget's updates
+    enum EditingItem {
+        EDITING_CANVAS = 1,
+        EDITING_OPACITY_SCALE = 2,
+        EDITING_RANGE = 4,
+        EDITING_PERCENTILES = 8,
+        EDITING_VALUES = 16
     };
+    uint32_t editing = 0;
 
-    std::vector<Colormap> colormaps;
-    size_t selected_colormap = 0;
-    std::vector<uint8_t> current_colormap;
-
-    std::vector<vec2f> alpha_control_pts = {vec2f(0.f), vec2f(1.f)};
-    size_t selected_point = -1;
-
-    float opacity_scale = 1.f;
-    ImVec2 range = ImVec2(0.f, 1.f);
-
-    bool clicked_on_item = false;
-    bool gpu_image_stale = true;
-    bool colormap_changed = true;
-    bool opacity_scale_changed = true;
-    bool range_changed = true;
-    GLuint colormap_img = -1;
+    GLTexture colormap_img;
     bool noGui;
+    // Draw the UI but skip all the GL calls, see SetHeadless
+    bool headless = false;
+    // The table version last uploaded to colormap_img
+    uint64_t gpu_table_version = -1;
+
+    // Histogram of the data shown behind the opacity curve, and its re-binning over
+    // the transfer function's range for display normalized to [0, 1]
+    Histogram histogram;
+    bool histogram_log_scale = false;
+    std::vector<float> histogram_display;
+    ImVec2 histogram_display_range = ImVec2(0.f, 0.f);
+    bool histogram_display_log_scale = false;
+    bool histogram_display_stale = true;
+
+    // Statistics of the data shown in the range editor, if set
+    VolumeStatistics data_statistics;
+    bool has_data_statistics = false;
+
+    // Sketch of the data used to pick the range automatically from percentiles
+    QuantileSketch quantile_sketch;
+    bool has_quantile_sketch = false;
+
+    // The 2D value x gradient magnitude transfer function edited in 2D mode
+    bool mode_2d = false;
+    TransferFunction2D tfn_2d;
+    uint64_t tfn_2d_read_version = 0;
+    uint64_t tfn_2d_gpu_version = 0;
+    GLTexture colormap_2d_img;
+    size_t selected_primitive = -1;
+
+    // What dragging the mouse on the 2D canvas does to the selected primitive
+    enum PrimitiveDrag { DRAG_NONE, DRAG_MOVE, DRAG_RESIZE };
+    PrimitiveDrag primitive_drag = DRAG_NONE;
+    vec2f primitive_drag_start;
+    TransferFunction2DPrimitive primitive_drag_origin;
 
 public:
     TransferFunctionWidget(bool noGui = false);
 
-    // Add a colormap preset. The image should be a 1D RGBA8 image, if the image
-    // is provided in sRGBA colorspace it will be linearized
-    void AddColormap(const Colormap &map);
+    // Widgets own their textures and tables, so they can't be copied. Moving transfers
+    // them without copying, e.g. when a vector of widgets grows. The moved-from widget
+    // can only be destroyed or assigned to
+    TransferFunctionWidget(const TransferFunctionWidget &) = delete;
+    TransferFunctionWidget &operator=(const TransferFunctionWidget &) = delete;
+    TransferFunctionWidget(TransferFunctionWidget &&w) noexcept;
+    TransferFunctionWidget &operator=(TransferFunctionWidget &&w) noexcept;
+
+    // Deletes the textures, so the widget's GL context must be current
+    ~TransferFunctionWidget();
 
-    // Add the transfer function UI into the currently active window
+    // Add the transfer function UI into the currently active window. In 2D mode
+    // this draws the 2D transfer function editor
     void DrawColorMap(bool show_help = true);
 
+    // Draw the UI without OpenGL, even if noGui is set: no textures are created or
+    // updated and the colormap images are drawn with stub texture IDs. Used to measure
+    // the UI's cost in an ImGui context without a renderer backend
+    void SetHeadless(bool enabled);
+
+    // Switch the editor between the 1D opacity curve and the 2D scalar value x
+    // gradient magnitude transfer function
+    void SetMode2D(bool enabled);
+
+    bool IsMode2D() const;
+
+    // Access the 2D transfer function, e.g. to add primitives or classify data
+    TransferFunction2D &GetTransferFunction2D();
+
     // Returns true if any of the widgets was updated since the last
-    // call to draw_ui
+    // call to draw_ui, including the 2D table in 2D mode
     bool Changed() const;
 
-    // Returns true if the colormap was updated since the last
-    // call to draw_ui
-    bool ColorMapChanged() const;
+    // Returns true if the 2D table was updated since the last
+    // call to GetColormap2D
+    bool ColorMap2DChanged() const;
 
-    // Returns true if the opacity scale was updated since the last
-    // call to draw_ui
-    bool OpacityScaleChanged() const;
+    // Get back the RGBA8 2D table, scalar value along x and gradient
+    // magnitude along y
+    const std::vector<uint8_t> &GetColormap2D();
 
-    // Returns true if the range was updated since the last
-    // call to draw_ui
-    bool RangeChanged() const;
+    // Show a histogram of the data behind the opacity curve. The histogram's value
+    // range is taken as the full data range and the part of it covered by the transfer
+    // function's range is displayed, re-binned from the histogram when the range changes
+    void SetHistogram(const Histogram &hist);
 
-    // Get back the RGBA8 color data for the transfer function
-    std::vector<uint8_t> GetColormap();
+    // Compute the histogram of count values read with the given stride in parallel
+    // and show it behind the opacity curve
+    template <typename T>
+    void SetHistogramData(const T *data,
+                          size_t count,
+                          size_t stride = 1,
+                          unsigned num_threads = 0);
 
-    // Get back the RGBA32F color data for the transfer function
-    std::vector<float> GetColormapf();
+    void ClearHistogram();
 
-    // Get back the RGBA32F color data for the transfer function
-    // as separate color and opacity vectors
-    void GetColormapf(std::vector<float> &color, std::vector<float> &opacity);
+    const Histogram &GetHistogram() const;
 
-    // Get back the opacity scale
-    float GetOpacityScale();
+    // Display the histogram counts on a log scale
+    void SetHistogramLogScale(bool log_scale);
 
-    // Get back the range
-    ImVec2 GetRange();
+    // Show the histogram of the statistics (see volume_statistics.h) behind the opacity
+    // curve, and the data's min, max and mean in the range editor, which then also
+    // allows editing the range in data values
+    void SetVolumeStatistics(const VolumeStatistics &stats);
+
+    // Set the quantile sketch of the data (see quantile_sketch.h), which enables the
+    // automatic range button in the range editor
+    void SetQuantileSketch(const QuantileSketch &sketch);
+
+    // Show the performance counters in the currently active window
+    void DrawStatsPanel();
 
     // Draws widget that scales opacity otherwise opacity is 1.0
     bool DrawOpacityScale();
@@ -107,26 +167,27 @@ public:
     // Draws widget that allows you to edit range for the colormap
     bool DrawRanges();
 
-    // Overlays the colormap bar on the image
-    void OverlayColormapBar(std::vector<uint32_t>& image, int imageWidth, int imageHeight, 
-                           vec2f pos, vec2f dataRange, float scale, bool flip_vertically = false);
-
-    // Load a state from a file
-    bool LoadState(const std::string &filepath);
-
-    // Save a state to a file
-    bool SaveState(const std::string &filepath);
-
 private:
     void UpdateGPUImage();
 
-    void UpdateColormap();
+    // Set or clear the item's bit in editing from whether the last item is active
+    void TrackEditing(EditingItem item);
+
+    void UpdateGPUImage2D();
 
-    void LoadEmbeddedPreset(const uint8_t *buf, size_t size, const std::string &name);
-    
-    // Helper function for drawing bitmap text on images
-    void DrawBitmapNumber(std::vector<uint32_t>& image, int imageWidth, int imageHeight, 
-                         float value, int x, int y, float scale, bool flip_vertically = false);
+    void DrawColorMap2D(bool show_help);
+
+    // Draw the histogram over the transfer function's range into the canvas
+    void DrawHistogram(ImDrawList *draw_list, const ImVec2 &canvas_pos, const ImVec2 &canvas_size);
 };
+
+template <typename T>
+void TransferFunctionWidget::SetHistogramData(const T *data,
+                                              size_t count,
+                                              size_t stride,
+                                              unsigned num_threads)
+{
+    SetHistogram(ComputeHistogram(data, count, stride, 4096, num_threads));
 }
 
+}
@@ -0,0 +1,460 @@
+#include "volume_statistics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include "thread_pool.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ImTF {
+
+namespace {
+
+// Values are first counted in bins of the leading bits of their float representation,
+// keeping the sign, exponent and 11 bits of mantissa
+const int key_bits = 20;
+const size_t num_keys = size_t(1) << key_bits;
+
+// Map a float's bits to an unsigned key with the same ordering as the values
+inline uint32_t float_key(float v)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+// The value of a key bin closest to zero, which is exact for small integers
+inline float key_bin_value(uint32_t bin)
+{
+    const uint32_t key = bin << (32 - key_bits);
+    uint32_t bits = (key & 0x80000000u) ? (key & 0x7FFFFFFFu) : ~key;
+    bits &= ~((1u << (32 - key_bits)) - 1);
+    float v;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+// 8 and 16-bit integers are counted exactly, with one key per value, since 11 bits of
+// mantissa would merge 16-bit values above 4095. Other types use the float keys
+template <typename T>
+inline uint32_t value_key(T v)
+{
+    return float_key(static_cast<float>(v)) >> (32 - key_bits);
+}
+
+inline uint32_t value_key(uint8_t v)
+{
+    return v;
+}
+
+inline uint32_t value_key(int8_t v)
+{
+    return static_cast<uint32_t>(v + 128);
+}
+
+inline uint32_t value_key(uint16_t v)
+{
+    return v;
+}
+
+inline uint32_t value_key(int16_t v)
+{
+    return static_cast<uint32_t>(v + 32768);
+}
+
+size_t num_value_keys(VoxelType type)
+{
+    switch (type) {
+    case VOXEL_UINT8:
+    case VOXEL_INT8:
+        return 256;
+    case VOXEL_UINT16:
+    case VOXEL_INT16:
+        return 65536;
+    default:
+        return num_keys;
+    }
+}
+
+// The value counted by a key of value_key
+float key_value(VoxelType type, uint32_t key)
+{
+    switch (type) {
+    case VOXEL_UINT8:
+    case VOXEL_UINT16:
+        return static_cast<float>(key);
+    case VOXEL_INT8:
+        return static_cast<float>(static_cast<int>(key) - 128);
+    case VOXEL_INT16:
+        return static_cast<float>(static_cast<int>(key) - 32768);
+    default:
+        return key_bin_value(key);
+    }
+}
+
+// Statistics accumulated by one worker
+struct PartialStatistics {
+    float min = std::numeric_limits<float>::max();
+    float max = std::numeric_limits<float>::lowest();
+    double sum = 0.0;
+    uint64_t count = 0;
+    std::vector<uint64_t> keys;
+    QuantileSketch quantiles;
+
+    PartialStatistics(size_t num_keys, uint64_t seed) : keys(num_keys, 0), quantiles(200, seed)
+    {
+    }
+};
+
+template <typename T>
+void accumulate(const T *data, size_t n, PartialStatistics &p)
+{
+    float lo = p.min;
+    float hi = p.max;
+    double sum = 0.0;
+    uint64_t count = 0;
+    uint64_t *keys = p.keys.data();
+    for (size_t i = 0; i < n; ++i) {
+        const float v = static_cast<float>(data[i]);
+        if (v != v) {
+            continue;
+        }
+        lo = v < lo ? v : lo;
+        hi = v > hi ? v : hi;
+        sum += v;
+        ++count;
+        ++keys[value_key(data[i])];
+        p.quantiles.Add(v);
+    }
+    p.min = lo;
+    p.max = hi;
+    p.sum += sum;
+    p.count += count;
+}
+
+void accumulate_voxels(const uint8_t *bytes, size_t n, VoxelType type, PartialStatistics &p)
+{
+    // Chunks may not be aligned for the type, so read through a small aligned copy
+    const size_t voxel_size = VoxelTypeSize(type);
+    const size_t block = 4096;
+    alignas(8) uint8_t aligned[block * 8];
+    for (size_t begin = 0; begin < n; begin += block) {
+        const size_t count = std::min(block, n - begin);
+        std::memcpy(aligned, bytes + begin * voxel_size, count * voxel_size);
+        switch (type) {
+        case VOXEL_UINT8:
+            accumulate(reinterpret_cast<const uint8_t *>(aligned), count, p);
+            break;
+        case VOXEL_INT8:
+            accumulate(reinterpret_cast<const int8_t *>(aligned), count, p);
+            break;
+        case VOXEL_UINT16:
+            accumulate(reinterpret_cast<const uint16_t *>(aligned), count, p);
+            break;
+        case VOXEL_INT16:
+            accumulate(reinterpret_cast<const int16_t *>(aligned), count, p);
+            break;
+        case VOXEL_UINT32:
+            accumulate(reinterpret_cast<const uint32_t *>(aligned), count, p);
+            break;
+        case VOXEL_INT32:
+            accumulate(reinterpret_cast<const int32_t *>(aligned), count, p);
+            break;
+        case VOXEL_FLOAT32:
+            accumulate(reinterpret_cast<const float *>(aligned), count, p);
+            break;
+        case VOXEL_FLOAT64:
+            accumulate(reinterpret_cast<const double *>(aligned), count, p);
+            break;
+        }
+    }
+}
+
+// Hands out one set of partial statistics per worker and combines them at the end
+class StatisticsAccumulator {
+    std::mutex mutex;
+    VoxelType type;
+    std::vector<std::unique_ptr<PartialStatistics>> all;
+    std::vector<PartialStatistics *> available;
+
+public:
+    StatisticsAccumulator(VoxelType type, size_t num_partials) : type(type)
+    {
+        for (size_t i = 0; i < num_partials; ++i) {
+            all.emplace_back(new PartialStatistics(num_value_keys(type), i + 1));
+            available.push_back(all.back().get());
+        }
+    }
+
+    void Accumulate(const uint8_t *bytes, size_t n)
+    {
+        PartialStatistics *p = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            p = available.back();
+            available.pop_back();
+        }
+        accumulate_voxels(bytes, n, type, *p);
+        std::lock_guard<std::mutex> lock(mutex);
+        available.push_back(p);
+    }
+
+    void Finish(VolumeStatistics &stats, size_t num_bins)
+    {
+        PartialStatistics &total = *all[0];
+        for (size_t i = 1; i < all.size(); ++i) {
+            total.min = std::min(total.min, all[i]->min);
+            total.max = std::max(total.max, all[i]->max);
+            total.sum += all[i]->sum;
+            total.count += all[i]->count;
+            AddBins(total.keys.data(), all[i]->keys.data(), total.keys.size());
+            total.quantiles.Merge(all[i]->quantiles);
+        }
+
+        stats = VolumeStatistics();
+        stats.histogram.bins.resize(num_bins, 0);
+        if (total.count == 0) {
+            return;
+        }
+        stats.min = total.min;
+        stats.max = total.max;
+        stats.mean = total.sum / total.count;
+        stats.count = total.count;
+        stats.histogram.min = total.min;
+        stats.histogram.max = total.max;
+        stats.quantiles = total.quantiles;
+
+        const float scale =
+            total.max > total.min ? num_bins / (total.max - total.min) : 0.f;
+        for (size_t k = 0; k < total.keys.size(); ++k) {
+            if (total.keys[k] == 0) {
+                continue;
+            }
+            const float v = clamp_value(key_value(type, static_cast<uint32_t>(k)), total);
+            const size_t b =
+                std::min(static_cast<size_t>((v - total.min) * scale), num_bins - 1);
+            stats.histogram.bins[b] += total.keys[k];
+        }
+    }
+
+private:
+    static float clamp_value(float v, const PartialStatistics &total)
+    {
+        return std::min(std::max(v, total.min), total.max);
+    }
+};
+
+bool compute_statistics(const uint8_t *bytes,
+                        size_t count,
+                        VoxelType type,
+                        VolumeStatistics &stats,
+                        const StatisticsProgress &progress,
+                        size_t num_bins,
+                        unsigned num_threads,
+                        size_t chunk_bytes)
+{
+    const size_t voxel_size = VoxelTypeSize(type);
+    const size_t chunk_voxels = std::max(chunk_bytes / voxel_size, size_t(1));
+
+    ThreadPool pool(num_threads);
+    StatisticsAccumulator accumulator(type, pool.Size());
+    // Only a few chunks are queued at a time, so cancelling stops the scan after the
+    // chunks already submitted instead of processing the whole volume
+    std::deque<std::pair<size_t, std::future<void>>> in_flight;
+    bool cancelled = false;
+    auto finish_oldest = [&]() {
+        in_flight.front().second.get();
+        if (!cancelled && progress) {
+            cancelled = !progress(in_flight.front().first * voxel_size, count * voxel_size);
+        }
+        in_flight.pop_front();
+    };
+
+    for (size_t begin = 0; begin < count && !cancelled;) {
+        if (in_flight.size() > pool.Size()) {
+            finish_oldest();
+            continue;
+        }
+        const size_t n = std::min(chunk_voxels, count - begin);
+        const uint8_t *chunk = bytes + begin * voxel_size;
+        in_flight.emplace_back(
+            begin + n, pool.Submit([&accumulator, chunk, n]() { accumulator.Accumulate(chunk, n); }));
+        begin += n;
+    }
+    while (!in_flight.empty()) {
+        finish_oldest();
+    }
+    if (cancelled) {
+        return false;
+    }
+    accumulator.Finish(stats, num_bins);
+    return true;
+}
+
+}
+
+size_t VoxelTypeSize(VoxelType type)
+{
+    switch (type) {
+    case VOXEL_UINT8:
+    case VOXEL_INT8:
+        return 1;
+    case VOXEL_UINT16:
+    case VOXEL_INT16:
+        return 2;
+    case VOXEL_UINT32:
+    case VOXEL_INT32:
+    case VOXEL_FLOAT32:
+        return 4;
+    case VOXEL_FLOAT64:
+        return 8;
+    }
+    return 1;
+}
+
+bool ComputeVolumeStatistics(const void *voxels,
+                             size_t count,
+                             VoxelType type,
+                             VolumeStatistics &stats,
+                             const StatisticsProgress &progress,
+                             size_t num_bins,
+                             unsigned num_threads)
+{
+    return compute_statistics(reinterpret_cast<const uint8_t *>(voxels),
+                              count,
+                              type,
+                              stats,
+                              progress,
+                              num_bins,
+                              num_threads,
+                              size_t(16) << 20);
+}
+
+bool ComputeRawVolumeStatistics(const std::string &filepath,
+                                VoxelType type,
+                                VolumeStatistics &stats,
+                                const StatisticsProgress &progress,
+                                size_t num_bins,
+                                size_t header_bytes,
+                                unsigned num_threads,
+                                size_t chunk_bytes)
+{
+    const size_t voxel_size = VoxelTypeSize(type);
+    chunk_bytes = std::max(chunk_bytes / voxel_size, size_t(1)) * voxel_size;
+
+#ifndef _WIN32
+    // Map the whole file and let the workers page it in, hinting that it's read
+    // sequentially so the kernel reads ahead
+    const int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            printf("Could not stat file %s\n", filepath.c_str());
+            return false;
+        }
+        const size_t file_size = static_cast<size_t>(st.st_size);
+        if (file_size <= header_bytes) {
+            close(fd);
+            stats = VolumeStatistics();
+            stats.histogram.bins.resize(num_bins, 0);
+            return true;
+        }
+        void *mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped != MAP_FAILED) {
+            madvise(mapped, file_size, MADV_SEQUENTIAL);
+            const size_t count = (file_size - header_bytes) / voxel_size;
+            const bool done =
+                compute_statistics(reinterpret_cast<const uint8_t *>(mapped) + header_bytes,
+                                   count,
+                                   type,
+                                   stats,
+                                   progress,
+                                   num_bins,
+                                   num_threads,
+                                   chunk_bytes);
+            munmap(mapped, file_size);
+            return done;
+        }
+    }
+#endif
+
+    // Stream the file through a few buffers, reading the next chunks while the
+    // workers process the previous ones
+    std::ifstream fp(filepath, std::ios::in | std::ios::binary);
+    if (!fp.is_open()) {
+        printf("Could not open file %s\n", filepath.c_str());
+        return false;
+    }
+    fp.seekg(0, std::ios::end);
+    const uint64_t file_size = static_cast<uint64_t>(fp.tellg());
+    const uint64_t total = file_size > header_bytes ? file_size - header_bytes : 0;
+    fp.seekg(header_bytes, std::ios::beg);
+
+    ThreadPool pool(num_threads);
+    StatisticsAccumulator accumulator(type, pool.Size());
+    struct Chunk {
+        std::vector<uint8_t> data;
+        uint64_t end;
+        std::future<void> done;
+    };
+    std::deque<Chunk> in_flight;
+    std::vector<std::vector<uint8_t>> free_buffers;
+    bool cancelled = false;
+    auto finish_oldest = [&]() {
+        Chunk &c = in_flight.front();
+        c.done.get();
+        if (!cancelled && progress) {
+            cancelled = !progress(c.end, total);
+        }
+        free_buffers.push_back(std::move(c.data));
+        in_flight.pop_front();
+    };
+
+    uint64_t read = 0;
+    while (read + voxel_size <= total && !cancelled) {
+        if (in_flight.size() > pool.Size()) {
+            finish_oldest();
+            continue;
+        }
+        Chunk c;
+        if (!free_buffers.empty()) {
+            c.data = std::move(free_buffers.back());
+            free_buffers.pop_back();
+        }
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(chunk_bytes, total - read));
+        c.data.resize(n);
+        fp.read(reinterpret_cast<char *>(c.data.data()), n);
+        const size_t got = static_cast<size_t>(fp.gcount()) / voxel_size;
+        if (got == 0) {
+            break;
+        }
+        read += n;
+        c.end = read;
+        const uint8_t *bytes = c.data.data();
+        c.done = pool.Submit(
+            [&accumulator, bytes, got]() { accumulator.Accumulate(bytes, got); });
+        in_flight.push_back(std::move(c));
+    }
+    while (!in_flight.empty()) {
+        finish_oldest();
+    }
+    if (cancelled) {
+        return false;
+    }
+    accumulator.Finish(stats, num_bins);
+    return true;
+}
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "histogram.h"
+#include "quantile_sketch.h"
+
+namespace ImTF {
+
+// The scalar type of the voxels of a raw volume
+enum VoxelType {
+    VOXEL_UINT8,
+    VOXEL_INT8,
+    VOXEL_UINT16,
+    VOXEL_INT16,
+    VOXEL_UINT32,
+    VOXEL_INT32,
+    VOXEL_FLOAT32,
+    VOXEL_FLOAT64
+};
+
+size_t VoxelTypeSize(VoxelType type);
+
+// Statistics of a volume's values, NaNs are excluded
+struct VolumeStatistics {
+    float min = 0.f;
+    float max = 0.f;
+    double mean = 0.0;
+    uint64_t count = 0;
+    // Histogram over [min, max]
+    Histogram histogram;
+    // Sketch of the value distribution for estimating percentiles, it can be merged
+    // with the sketches of other files or timesteps
+    QuantileSketch quantiles;
+};
+
+// Called as data is processed with the bytes processed so far and the total, return
+// false to cancel
+using StatisticsProgress = std::function<bool(uint64_t bytes_done, uint64_t bytes_total)>;
+
+// Compute the min, max, mean, a histogram and a quantile sketch of count voxels in a single pass over
+// the data, processing chunks of it in parallel on num_threads threads (0 for one per
+// hardware thread). 8 and 16-bit integer values are counted exactly, other values are
+// first binned by their leading bits, which tracks them to within 0.05% of their
+// magnitude without knowing the range up front, and those counts are then spread over
+// num_bins bins between the min and max.
+// Returns false if cancelled by the progress callback
+bool ComputeVolumeStatistics(const void *voxels,
+                             size_t count,
+                             VoxelType type,
+                             VolumeStatistics &stats,
+                             const StatisticsProgress &progress = StatisticsProgress(),
+                             size_t num_bins = 4096,
+                             unsigned num_threads = 0);
+
+// Compute the statistics of a raw volume file larger than memory in one pass. The
+// file is memory mapped (or streamed through read-ahead buffers where mapping isn't
+// available) and processed in chunks of chunk_bytes in parallel. header_bytes are
+// skipped at the start of the file. Returns false if the file can't be read or the
+// progress callback cancels
+bool ComputeRawVolumeStatistics(const std::string &filepath,
+                                VoxelType type,
+                                VolumeStatistics &stats,
+                                const StatisticsProgress &progress = StatisticsProgress(),
+                                size_t num_bins = 4096,
+                                size_t header_bytes = 0,
+                                unsigned num_threads = 0,
+                                size_t chunk_bytes = size_t(64) << 20);
+}